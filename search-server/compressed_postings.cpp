@@ -0,0 +1,189 @@
+#include "compressed_postings.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Values of a block are packed in LANE_COUNT interleaved streams: value i
+// goes to lane i % LANE_COUNT, and word w of a lane is stored at
+// w * LANE_COUNT + lane. A row of LANE_COUNT consecutive values thus
+// unpacks from one vector of words with the same shifts for every lane.
+const size_t LANE_COUNT = 4;
+// Padding after the packed words, so a row may always read the vector of
+// words after the one holding it
+const size_t PADDING_WORD_COUNT = 2 * LANE_COUNT;
+
+uint8_t GetBitWidth(uint32_t max_value) {
+    return static_cast<uint8_t>(std::bit_width(max_value));
+}
+
+size_t GetRowCount(size_t count) {
+    return (count + LANE_COUNT - 1) / LANE_COUNT;
+}
+
+void Pack(const uint32_t* values, size_t count, uint8_t bits, std::vector<uint32_t>& words) {
+    if (bits == 0) {
+        return;
+    }
+    const size_t begin = words.size();
+    words.resize(begin + (GetRowCount(count) * bits + 31) / 32 * LANE_COUNT, 0);
+    for (size_t i = 0; i < count; ++i) {
+        const size_t bit = i / LANE_COUNT * bits;
+        const size_t word = begin + bit / 32 * LANE_COUNT + i % LANE_COUNT;
+        const size_t shift = bit % 32;
+        words[word] |= static_cast<uint32_t>(uint64_t{ values[i] } << shift);
+        if (shift + bits > 32) {
+            words[word + LANE_COUNT] |= static_cast<uint32_t>(uint64_t{ values[i] } >> (32 - shift));
+        }
+    }
+}
+
+// Writes whole rows, so values must have room for count rounded up to LANE_COUNT
+void Unpack(const uint32_t* words, size_t count, uint8_t bits, uint32_t* values) {
+    const size_t row_count = GetRowCount(count);
+#ifdef __SSE2__
+    const __m128i mask = _mm_set1_epi32(static_cast<int>((uint64_t{ 1 } << bits) - 1));
+    for (size_t row = 0; row < row_count; ++row) {
+        const size_t bit = row * bits;
+        const __m128i* lanes = reinterpret_cast<const __m128i*>(words + bit / 32 * LANE_COUNT);
+        // A shift by 32 gives zero, so a row within a single word takes nothing from the next one
+        const __m128i low = _mm_srl_epi32(_mm_loadu_si128(lanes), _mm_cvtsi32_si128(static_cast<int>(bit % 32)));
+        const __m128i high = _mm_sll_epi32(_mm_loadu_si128(lanes + 1),
+            _mm_cvtsi32_si128(static_cast<int>(32 - bit % 32)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + row * LANE_COUNT),
+            _mm_and_si128(_mm_or_si128(low, high), mask));
+    }
+#else
+    const uint64_t mask = (uint64_t{ 1 } << bits) - 1;
+    for (size_t row = 0; row < row_count; ++row) {
+        const size_t bit = row * bits;
+        const uint32_t* lanes = words + bit / 32 * LANE_COUNT;
+        for (size_t lane = 0; lane < LANE_COUNT; ++lane) {
+            const uint64_t pair = lanes[lane] | (uint64_t{ lanes[lane + LANE_COUNT] } << 32);
+            values[row * LANE_COUNT + lane] = static_cast<uint32_t>((pair >> (bit % 32)) & mask);
+        }
+    }
+#endif
+}
+
+// document_ids[i] = base + (gaps[0] + 1) + ... + (gaps[i] + 1), a row of
+// LANE_COUNT ids at a time; writes whole rows like Unpack()
+void DecodeGaps(const uint32_t* gaps, size_t count, int base, int* document_ids) {
+#ifdef __SSE2__
+    const __m128i one = _mm_set1_epi32(1);
+    __m128i previous = _mm_set1_epi32(base);
+    for (size_t i = 0; i < count; i += LANE_COUNT) {
+        __m128i row = _mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(gaps + i)), one);
+        row = _mm_add_epi32(row, _mm_slli_si128(row, 4));
+        row = _mm_add_epi32(row, _mm_slli_si128(row, 8));
+        row = _mm_add_epi32(row, previous);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(document_ids + i), row);
+        previous = _mm_shuffle_epi32(row, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+#else
+    uint32_t document_id = static_cast<uint32_t>(base);
+    for (size_t i = 0; i < count; ++i) {
+        document_id += gaps[i] + 1;
+        document_ids[i] = static_cast<int>(document_id);
+    }
+#endif
+}
+
+}  // namespace
+
+CompressedPostings::CompressedPostings(const std::vector<int>& document_ids, const std::vector<int>& ordinals,
+    const std::vector<double>& term_freqs)
+    : term_freq_table_(term_freqs)
+    , size_(document_ids.size()) {
+    std::sort(term_freq_table_.begin(), term_freq_table_.end());
+    term_freq_table_.erase(std::unique(term_freq_table_.begin(), term_freq_table_.end()), term_freq_table_.end());
+    const uint8_t term_freq_bits = GetBitWidth(static_cast<uint32_t>(
+        term_freq_table_.empty() ? 0 : term_freq_table_.size() - 1));
+
+    std::array<uint32_t, BLOCK_SIZE> values;
+    for (size_t begin = 0; begin < document_ids.size(); begin += BLOCK_SIZE) {
+        const size_t size = std::min(BLOCK_SIZE, document_ids.size() - begin);
+        BlockHeader header{ document_ids[begin], document_ids[begin + size - 1], 0, 0, 0,
+            static_cast<uint16_t>(size), 0, 0, term_freq_bits };
+
+        // Ids are strictly increasing, so gaps are stored minus one; the
+        // first id is in the header, and its gap is zero
+        uint32_t max_gap = 0;
+        values[0] = 0;
+        for (size_t i = 1; i < size; ++i) {
+            values[i] = static_cast<uint32_t>(document_ids[begin + i] - document_ids[begin + i - 1] - 1);
+            max_gap = std::max(max_gap, values[i]);
+        }
+        header.document_id_bits = GetBitWidth(max_gap);
+        header.document_ids_offset = static_cast<uint32_t>(words_.size());
+        Pack(values.data(), size, header.document_id_bits, words_);
+
+        uint32_t max_ordinal = 0;
+        for (size_t i = 0; i < size; ++i) {
+            values[i] = static_cast<uint32_t>(ordinals[begin + i]);
+            max_ordinal = std::max(max_ordinal, values[i]);
+        }
+        header.ordinal_bits = GetBitWidth(max_ordinal);
+        header.ordinals_offset = static_cast<uint32_t>(words_.size());
+        Pack(values.data(), size, header.ordinal_bits, words_);
+
+        for (size_t i = 0; i < size; ++i) {
+            values[i] = static_cast<uint32_t>(std::lower_bound(term_freq_table_.begin(), term_freq_table_.end(),
+                term_freqs[begin + i]) - term_freq_table_.begin());
+        }
+        header.term_freqs_offset = static_cast<uint32_t>(words_.size());
+        Pack(values.data(), size, term_freq_bits, words_);
+
+        blocks_.push_back(header);
+    }
+    words_.resize(words_.size() + PADDING_WORD_COUNT, 0);
+}
+
+size_t CompressedPostings::FindBlock(int document_id, size_t from_block) const {
+    return std::partition_point(blocks_.begin() + std::min(from_block, blocks_.size()), blocks_.end(),
+        [document_id](const BlockHeader& header) {
+            return header.last_document_id < document_id;
+        }) - blocks_.begin();
+}
+
+size_t CompressedPostings::DecodeBlock(size_t block, int* document_ids, int* ordinals, double* term_freqs) const {
+    const BlockHeader& header = blocks_[block];
+    std::array<uint32_t, BLOCK_SIZE> values;
+
+    Unpack(words_.data() + header.document_ids_offset, header.size, header.document_id_bits, values.data());
+    // The first gap of zero plus one restores the first id
+    DecodeGaps(values.data(), header.size, header.first_document_id - 1, document_ids);
+
+    Unpack(words_.data() + header.ordinals_offset, header.size, header.ordinal_bits,
+        reinterpret_cast<uint32_t*>(ordinals));
+
+    Unpack(words_.data() + header.term_freqs_offset, header.size, header.term_freq_bits, values.data());
+    for (size_t i = 0; i < header.size; ++i) {
+        term_freqs[i] = term_freq_table_[values[i]];
+    }
+    return header.size;
+}
+
+bool CompressedPostings::Contains(int document_id) const {
+    const size_t block = FindBlock(document_id);
+    if (block == blocks_.size() || blocks_[block].first_document_id > document_id) {
+        return false;
+    }
+    std::array<int, BLOCK_SIZE> document_ids;
+    std::array<int, BLOCK_SIZE> ordinals;
+    std::array<double, BLOCK_SIZE> term_freqs;
+    const size_t size = DecodeBlock(block, document_ids.data(), ordinals.data(), term_freqs.data());
+    return std::binary_search(document_ids.begin(), document_ids.begin() + size, document_id);
+}
+
+size_t CompressedPostings::GetMemoryUsage() const {
+    return blocks_.capacity() * sizeof(BlockHeader)
+        + words_.capacity() * sizeof(uint32_t)
+        + term_freq_table_.capacity() * sizeof(double);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Read-only compressed form of a posting list.
+// Document ids are split into blocks of BLOCK_SIZE, delta-encoded and
+// bit-packed with the smallest width that fits the block. Values are packed
+// in interleaved lanes, so blocks decode with SSE2 where available, a row of
+// values and a step of the gap prefix sum per instruction. Term frequencies
+// are quantized losslessly: each one is an index into a table of the
+// distinct frequencies of the list, packed the same way. Document ordinals
+// are packed as they are, with the width of the largest one in the block.
+// Block headers keep the first and last ids, so lookups decode a single block.
+class CompressedPostings {
+public:
+    inline static const size_t BLOCK_SIZE = 128;
+
+    CompressedPostings() = default;
+
+    // document_ids must be sorted in ascending order
+    CompressedPostings(const std::vector<int>& document_ids, const std::vector<int>& ordinals,
+        const std::vector<double>& term_freqs);
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    size_t GetBlockCount() const {
+        return blocks_.size();
+    }
+
+    // Index of the first block at or after from_block that may contain ids
+    // not less than document_id; GetBlockCount() if there is none
+    size_t FindBlock(int document_id, size_t from_block = 0) const;
+
+    // Writes the postings of the block and returns their number; the arrays
+    // must have room for BLOCK_SIZE postings
+    size_t DecodeBlock(size_t block, int* document_ids, int* ordinals, double* term_freqs) const;
+
+    bool Contains(int document_id) const;
+
+    size_t GetMemoryUsage() const;
+
+private:
+    struct BlockHeader {
+        int first_document_id;
+        int last_document_id;
+        uint32_t document_ids_offset;
+        uint32_t ordinals_offset;
+        uint32_t term_freqs_offset;
+        uint16_t size;
+        uint8_t document_id_bits;
+        uint8_t ordinal_bits;
+        uint8_t term_freq_bits;
+    };
+
+    std::vector<BlockHeader> blocks_;
+    // Packed words of all blocks followed by padding, so decoders may always
+    // read the word after the one holding a value
+    std::vector<uint32_t> words_;
+    std::vector<double> term_freq_table_;
+    size_t size_ = 0;
+};
@@ -0,0 +1,42 @@
+#include "concurrent_search_server.h"
+
+void ConcurrentSearchServer::AddDocument(int document_id, const std::string_view& document, DocumentStatus status,
+    const std::vector<int>& ratings) {
+    Write([document_id, &document, status, &ratings](SearchServer& server) {
+        server.AddDocument(document_id, document, status, ratings);
+    });
+}
+
+void ConcurrentSearchServer::RemoveDocument(int document_id) {
+    Write([document_id](SearchServer& server) {
+        server.RemoveDocument(document_id);
+    });
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> ConcurrentSearchServer::MatchDocument(
+    const std::string_view& raw_query, int document_id) const {
+    return Read([&raw_query, document_id](const SearchServer& server) {
+        return server.MatchDocument(raw_query, document_id);
+    });
+}
+
+size_t ConcurrentSearchServer::GetDocumentCount() const {
+    return Read([](const SearchServer& server) {
+        return server.GetDocumentCount();
+    });
+}
+
+void ConcurrentSearchServer::WaitForReaders() {
+    // Readers that arrived at the old version may still read the instance
+    // published before, so drain the new version first, switch new readers
+    // to it and then drain the old one
+    const int version = version_.load(std::memory_order_relaxed);
+    const int next_version = 1 - version;
+    while (!read_indicators_[next_version].IsEmpty()) {
+        std::this_thread::yield();
+    }
+    version_.store(next_version);
+    while (!read_indicators_[version].IsEmpty()) {
+        std::this_thread::yield();
+    }
+}
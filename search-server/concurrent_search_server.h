@@ -0,0 +1,136 @@
+#pragma once
+
+#include "document.h"
+#include "search_server.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// Search server that serves queries while documents are added and removed.
+// It keeps two copies of the index (the left-right technique): queries
+// read the published copy without locking, and a writer changes the other
+// copy, publishes it, waits until no query reads the old copy and repeats
+// the change there. Writers are serialized; a query sees either the state
+// before or after each change.
+class ConcurrentSearchServer {
+public:
+    template <typename... Args>
+    explicit ConcurrentSearchServer(const Args&... args)
+        : instances_{ SearchServer(args...), SearchServer(args...) } {
+    }
+
+    void AddDocument(int document_id, const std::string_view& document, DocumentStatus status,
+        const std::vector<int>& ratings);
+
+    template <typename ExecutionPolicy>
+    void AddDocuments(const ExecutionPolicy& policy, const std::vector<NewDocument>& documents) {
+        Write([&policy, &documents](SearchServer& server) {
+            server.AddDocuments(policy, documents);
+        });
+    }
+
+    void RemoveDocument(int document_id);
+
+    // Calls func with the published server; func must not keep references
+    // into it after returning
+    template <typename Func>
+    auto Read(Func func) const {
+        const ReadGuard guard(*this);
+        return func(instances_[published_instance_.load()]);
+    }
+
+    template <typename... Args>
+    std::vector<Document> FindTopDocuments(const Args&... args) const {
+        return Read([&args...](const SearchServer& server) {
+            return server.FindTopDocuments(args...);
+        });
+    }
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view& raw_query,
+        int document_id) const;
+
+    size_t GetDocumentCount() const;
+
+private:
+    // Number of readers of one version, spread over cache lines by thread
+    class ReadIndicator {
+    public:
+        void Arrive() {
+            stripes_[GetStripe()].readers.fetch_add(1);
+        }
+
+        void Depart() {
+            stripes_[GetStripe()].readers.fetch_sub(1, std::memory_order_release);
+        }
+
+        bool IsEmpty() const {
+            for (const Stripe& stripe : stripes_) {
+                if (stripe.readers.load() != 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    private:
+        inline static const size_t STRIPE_COUNT = 16;
+
+        struct alignas(64) Stripe {
+            std::atomic<int64_t> readers{ 0 };
+        };
+
+        static size_t GetStripe() {
+            thread_local const size_t stripe = std::hash<std::thread::id>{}(std::this_thread::get_id()) % STRIPE_COUNT;
+            return stripe;
+        }
+
+        std::array<Stripe, STRIPE_COUNT> stripes_;
+    };
+
+    class ReadGuard {
+    public:
+        explicit ReadGuard(const ConcurrentSearchServer& server)
+            : indicator_(server.read_indicators_[server.version_.load()]) {
+            indicator_.Arrive();
+        }
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+        ~ReadGuard() {
+            indicator_.Depart();
+        }
+
+    private:
+        ReadIndicator& indicator_;
+    };
+
+    // Applies the change to both instances. If it throws on the first one,
+    // nothing is published.
+    template <typename Mutation>
+    void Write(Mutation mutation) {
+        const std::lock_guard guard(writer_mutex_);
+        const int published = published_instance_.load(std::memory_order_relaxed);
+        mutation(instances_[1 - published]);
+        published_instance_.store(1 - published);
+        WaitForReaders();
+        mutation(instances_[published]);
+    }
+
+    // Returns when no query started before the call still reads any instance
+    void WaitForReaders();
+
+    std::array<SearchServer, 2> instances_;
+    std::atomic<int> published_instance_{ 0 };
+    std::atomic<int> version_{ 0 };
+    mutable std::array<ReadIndicator, 2> read_indicators_;
+    std::mutex writer_mutex_;
+};
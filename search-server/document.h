@@ -1,6 +1,8 @@
 #pragma once
 
 #include <ostream>
+#include <string_view>
+#include <vector>
 
 struct Document {
     Document() = default;
@@ -23,4 +25,12 @@ enum class DocumentStatus {
     REMOVED,
 };
 
+// Input of SearchServer::AddDocuments; the text must outlive the call only
+struct NewDocument {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
+
 std::ostream& operator<<(std::ostream& out, const Document& document);
\ No newline at end of file
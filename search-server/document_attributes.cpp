@@ -0,0 +1,53 @@
+#include "document_attributes.h"
+
+#include <algorithm>
+
+int DocumentAttributes::Add(int document_id, DocumentStatus status, int rating) {
+    int ordinal = 0;
+    if (free_ordinals_.empty()) {
+        ordinal = static_cast<int>(document_ids_.size());
+        document_ids_.push_back(document_id);
+        statuses_.push_back(static_cast<uint8_t>(status));
+        ratings_.push_back(rating);
+    }
+    else {
+        ordinal = free_ordinals_.back();
+        free_ordinals_.pop_back();
+        document_ids_[ordinal] = document_id;
+        statuses_[ordinal] = static_cast<uint8_t>(status);
+        ratings_[ordinal] = rating;
+    }
+    ordinals_.Insert(document_id, ordinal);
+    return ordinal;
+}
+
+void DocumentAttributes::Remove(int document_id) {
+    const int ordinal = ordinals_.Find(document_id);
+    if (ordinal < 0) {
+        return;
+    }
+    ordinals_.Erase(document_id);
+    document_ids_[ordinal] = -1;
+    statuses_[ordinal] = NO_STATUS;
+    free_ordinals_.push_back(ordinal);
+}
+
+void DocumentAttributes::Filter(const DocumentFilter& filter, std::vector<uint64_t>& words) const {
+    const size_t size = document_ids_.size();
+    words.assign((size + 63) / 64, 0);
+    const uint32_t status_mask = filter.status_mask;
+    // Branch-free over the columns, so each word of 64 documents vectorizes
+    for (size_t begin = 0; begin < size; begin += 64) {
+        const size_t count = std::min<size_t>(64, size - begin);
+        const uint8_t* statuses = statuses_.data() + begin;
+        const int* ratings = ratings_.data() + begin;
+        uint64_t word = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const uint64_t accepted = ((status_mask >> statuses[i]) & 1)
+                & static_cast<uint64_t>(ratings[i] >= filter.min_rating)
+                & static_cast<uint64_t>(ratings[i] <= filter.max_rating);
+            word |= accepted << i;
+        }
+        words[begin / 64] = word;
+    }
+}
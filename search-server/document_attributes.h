@@ -0,0 +1,93 @@
+#pragma once
+
+#include "document.h"
+#include "document_ordinal_map.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Filter on document attributes that is evaluated for all documents at once
+// rather than per posting, unless the query has few postings
+struct DocumentFilter {
+    inline static const uint8_t ALL_STATUSES = 0xF;
+
+    static uint8_t GetStatusBit(DocumentStatus status) {
+        return static_cast<uint8_t>(1u << static_cast<int>(status));
+    }
+
+    // Also usable as an ordinary document predicate
+    bool operator()(int, DocumentStatus status, int rating) const {
+        return (status_mask & GetStatusBit(status)) != 0 && rating >= min_rating && rating <= max_rating;
+    }
+
+    // Bit i accepts the status with value i
+    uint8_t status_mask = ALL_STATUSES;
+    int min_rating = std::numeric_limits<int>::min();
+    int max_rating = std::numeric_limits<int>::max();
+};
+
+// Bitset over document ordinals accepted by a filter
+struct CandidateOrdinals {
+    bool Contains(int ordinal) const {
+        return (words[ordinal / 64] >> (ordinal % 64)) & 1;
+    }
+
+    const uint64_t* words;
+};
+
+// Columnar store of document attributes.
+// Documents get compact ordinals, and ratings, statuses and ids are kept in
+// dense arrays indexed by ordinal; ordinals of removed documents are reused.
+class DocumentAttributes {
+public:
+    // Returns the ordinal of the document, which must be absent
+    int Add(int document_id, DocumentStatus status, int rating);
+
+    void Remove(int document_id);
+
+    bool Contains(int document_id) const {
+        return ordinals_.Find(document_id) >= 0;
+    }
+
+    size_t size() const {
+        return ordinals_.size();
+    }
+
+    // Returns -1 if the document is absent
+    int FindOrdinal(int document_id) const {
+        return ordinals_.Find(document_id);
+    }
+
+    // All ordinals are below the bound
+    size_t GetOrdinalBound() const {
+        return document_ids_.size();
+    }
+
+    int GetDocumentId(int ordinal) const {
+        return document_ids_[ordinal];
+    }
+
+    DocumentStatus GetStatus(int ordinal) const {
+        return static_cast<DocumentStatus>(statuses_[ordinal]);
+    }
+
+    int GetRating(int ordinal) const {
+        return ratings_[ordinal];
+    }
+
+    // Replaces words with a bitset of GetOrdinalBound() bits in which the
+    // ordinals of the accepted documents are set
+    void Filter(const DocumentFilter& filter, std::vector<uint64_t>& words) const;
+
+private:
+    // Status of free ordinals, accepted by no filter
+    inline static const uint8_t NO_STATUS = 7;
+
+    DocumentOrdinalMap ordinals_;
+    std::vector<int> document_ids_;
+    std::vector<uint8_t> statuses_;
+    std::vector<int> ratings_;
+    std::vector<int> free_ordinals_;
+};
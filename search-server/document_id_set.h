@@ -0,0 +1,69 @@
+#pragma once
+
+#include "inverted_index.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Sorted set of document ids, e.g. the documents excluded by minus words
+class DocumentIdSet {
+public:
+    // Answers membership queries for non-decreasing document ids, galloping
+    // over runs of smaller ids
+    class Cursor {
+    public:
+        explicit Cursor(const std::vector<int>& document_ids)
+            : document_ids_(document_ids) {
+        }
+
+        bool Contains(int document_id) {
+            const size_t size = document_ids_.size();
+            if (position_ < size && document_ids_[position_] < document_id) {
+                size_t step = 1;
+                size_t bound = position_ + 1;
+                while (bound < size && document_ids_[bound] < document_id) {
+                    position_ = bound;
+                    step *= 2;
+                    bound = position_ + step;
+                }
+                position_ = std::lower_bound(document_ids_.begin() + position_,
+                    document_ids_.begin() + std::min(bound, size), document_id) - document_ids_.begin();
+            }
+            return position_ < size && document_ids_[position_] == document_id;
+        }
+
+    private:
+        const std::vector<int>& document_ids_;
+        size_t position_ = 0;
+    };
+
+    // Replaces the contents with the union of the documents of all posting lists
+    void AssignUnion(const std::vector<const PostingList*>& postings) {
+        document_ids_.clear();
+        for (const PostingList* word_postings : postings) {
+            for (const auto [document_id, _] : *word_postings) {
+                document_ids_.push_back(document_id);
+            }
+        }
+        if (postings.size() > 1) {
+            std::sort(document_ids_.begin(), document_ids_.end());
+            document_ids_.erase(std::unique(document_ids_.begin(), document_ids_.end()), document_ids_.end());
+        }
+    }
+
+    bool empty() const {
+        return document_ids_.empty();
+    }
+
+    size_t size() const {
+        return document_ids_.size();
+    }
+
+    Cursor MakeCursor() const {
+        return Cursor(document_ids_);
+    }
+
+private:
+    std::vector<int> document_ids_;
+};
@@ -0,0 +1,55 @@
+#include "document_ordinal_map.h"
+
+#include <utility>
+
+void DocumentOrdinalMap::Insert(int document_id, int ordinal) {
+    if (2 * (size_ + 1) > slots_.size()) {
+        Rehash(slots_.empty() ? 16 : slots_.size() * 2);
+    }
+    size_t slot = GetHomeSlot(document_id);
+    while (slots_[slot].document_id != EMPTY) {
+        slot = (slot + 1) & (slots_.size() - 1);
+    }
+    slots_[slot] = { document_id, ordinal };
+    ++size_;
+}
+
+void DocumentOrdinalMap::Erase(int document_id) {
+    if (slots_.empty()) {
+        return;
+    }
+    const size_t mask = slots_.size() - 1;
+    size_t slot = GetHomeSlot(document_id);
+    while (slots_[slot].document_id != document_id) {
+        if (slots_[slot].document_id == EMPTY) {
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+    // Backward shift: move later entries of the probe run into the hole
+    // unless their home slot lies cyclically after the hole
+    size_t hole = slot;
+    for (size_t next = (hole + 1) & mask; slots_[next].document_id != EMPTY; next = (next + 1) & mask) {
+        const size_t home = GetHomeSlot(slots_[next].document_id);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            slots_[hole] = slots_[next];
+            hole = next;
+        }
+    }
+    slots_[hole] = Slot{};
+    --size_;
+}
+
+void DocumentOrdinalMap::Rehash(size_t slot_count) {
+    std::vector<Slot> old_slots = std::exchange(slots_, std::vector<Slot>(slot_count));
+    shift_ = 64;
+    for (size_t count = slot_count; count > 1; count /= 2) {
+        --shift_;
+    }
+    size_ = 0;
+    for (const Slot& slot : old_slots) {
+        if (slot.document_id != EMPTY) {
+            Insert(slot.document_id, slot.ordinal);
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Hash map from document id to internal ordinal.
+// Open addressing with linear probing over one flat array, kept at most
+// half full; a lookup usually touches a single cache line.
+class DocumentOrdinalMap {
+public:
+    // Returns -1 if the document is absent
+    int Find(int document_id) const {
+        if (slots_.empty()) {
+            return -1;
+        }
+        for (size_t slot = GetHomeSlot(document_id); slots_[slot].document_id != EMPTY;
+            slot = (slot + 1) & (slots_.size() - 1)) {
+            if (slots_[slot].document_id == document_id) {
+                return slots_[slot].ordinal;
+            }
+        }
+        return -1;
+    }
+
+    // document_id must be non-negative and absent
+    void Insert(int document_id, int ordinal);
+
+    void Erase(int document_id);
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    inline static const int EMPTY = -1;
+
+    struct Slot {
+        int document_id = EMPTY;
+        int ordinal = 0;
+    };
+
+    size_t GetHomeSlot(int document_id) const {
+        return static_cast<size_t>((static_cast<uint64_t>(static_cast<uint32_t>(document_id))
+            * 0x9E3779B97F4A7C15ull) >> shift_);
+    }
+
+    void Rehash(size_t slot_count);
+
+    std::vector<Slot> slots_;
+    // 64 minus the log2 of the slot count
+    int shift_ = 64;
+    size_t size_ = 0;
+};
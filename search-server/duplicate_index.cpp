@@ -0,0 +1,31 @@
+#include "duplicate_index.h"
+
+#include <algorithm>
+
+void DuplicateIndex::Add(uint64_t fingerprint, int document_id) {
+    std::vector<int>& document_ids = documents_by_fingerprint_[fingerprint];
+    document_ids.insert(std::lower_bound(document_ids.begin(), document_ids.end(), document_id), document_id);
+    ++size_;
+}
+
+void DuplicateIndex::Remove(uint64_t fingerprint, int document_id) {
+    const auto it = documents_by_fingerprint_.find(fingerprint);
+    if (it == documents_by_fingerprint_.end()) {
+        return;
+    }
+    std::vector<int>& document_ids = it->second;
+    const auto position = std::lower_bound(document_ids.begin(), document_ids.end(), document_id);
+    if (position == document_ids.end() || *position != document_id) {
+        return;
+    }
+    document_ids.erase(position);
+    --size_;
+    if (document_ids.empty()) {
+        documents_by_fingerprint_.erase(it);
+    }
+}
+
+void DuplicateIndex::Clear() {
+    documents_by_fingerprint_.clear();
+    size_ = 0;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+enum class DuplicateDetection {
+    DISABLED,
+    // Duplicates are indexed, and SearchServer::FindOriginalDocument() names their originals
+    REPORT,
+    // Adding a duplicate throws std::invalid_argument
+    REJECT,
+};
+
+// Documents grouped by the fingerprint of their word sets. Documents with
+// different words may share a fingerprint, so lookups confirm the content
+// with a callback.
+class DuplicateIndex {
+public:
+    // Returns the smallest id of an indexed document with the fingerprint
+    // for which is_same_content(document_id) holds, or -1
+    template <typename IsSameContent>
+    int Find(uint64_t fingerprint, IsSameContent is_same_content) const {
+        const auto it = documents_by_fingerprint_.find(fingerprint);
+        if (it == documents_by_fingerprint_.end()) {
+            return -1;
+        }
+        for (const int document_id : it->second) {
+            if (is_same_content(document_id)) {
+                return document_id;
+            }
+        }
+        return -1;
+    }
+
+    // Calls func(document_ids) for every fingerprint shared by several
+    // documents, with their ids in ascending order
+    template <typename Func>
+    void ForEachSharedFingerprint(Func func) const {
+        for (const auto& [fingerprint, document_ids] : documents_by_fingerprint_) {
+            if (document_ids.size() > 1) {
+                func(document_ids);
+            }
+        }
+    }
+
+    void Add(uint64_t fingerprint, int document_id);
+
+    void Remove(uint64_t fingerprint, int document_id);
+
+    void Clear();
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    // Ids in ascending order
+    std::unordered_map<uint64_t, std::vector<int>> documents_by_fingerprint_;
+    size_t size_ = 0;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "term_dictionary.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Inverse document frequencies of terms, computed on first use.
+// Every change of the indexed documents starts a new epoch, and an entry
+// computed in an older epoch is recomputed when it is requested again.
+// Queries never run concurrently with index mutations, so readers of one
+// epoch may race only to store identical values.
+class InverseDocumentFreqCache {
+public:
+    InverseDocumentFreqCache() = default;
+
+    InverseDocumentFreqCache(InverseDocumentFreqCache&&) = default;
+    InverseDocumentFreqCache& operator=(InverseDocumentFreqCache&&) = default;
+
+    void Invalidate() {
+        ++epoch_;
+    }
+
+    // Makes room for the terms with ids below term_id_bound
+    void Reserve(size_t term_id_bound) {
+        if (term_id_bound <= size_) {
+            return;
+        }
+        const size_t size = std::max(term_id_bound, size_ * 2);
+        auto entries = std::make_unique<Entry[]>(size);
+        for (size_t i = 0; i < size_; ++i) {
+            entries[i].epoch.store(entries_[i].epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            entries[i].value.store(entries_[i].value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        entries_ = std::move(entries);
+        size_ = size;
+    }
+
+    template <typename ComputeFunc>
+    double Get(TermId term_id, ComputeFunc compute) const {
+        if (term_id >= size_) {
+            return compute();
+        }
+        Entry& entry = entries_[term_id];
+        if (entry.epoch.load(std::memory_order_acquire) == epoch_) {
+            return entry.value.load(std::memory_order_relaxed);
+        }
+        const double value = compute();
+        entry.value.store(value, std::memory_order_relaxed);
+        entry.epoch.store(epoch_, std::memory_order_release);
+        return value;
+    }
+
+private:
+    struct Entry {
+        std::atomic<uint64_t> epoch{ 0 };
+        std::atomic<double> value{ 0.0 };
+    };
+
+    uint64_t epoch_ = 1;
+    std::unique_ptr<Entry[]> entries_;
+    size_t size_ = 0;
+};
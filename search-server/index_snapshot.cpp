@@ -0,0 +1,64 @@
+#include "index_snapshot.h"
+
+void SnapshotWriter::WriteHeader() {
+    Write(SNAPSHOT_MAGIC);
+    Write(SNAPSHOT_VERSION);
+    Write(SNAPSHOT_BYTE_ORDER_MARK);
+}
+
+void SnapshotWriter::WriteString(std::string_view text) {
+    Write<uint64_t>(text.size());
+    WriteBytes(text.data(), text.size());
+}
+
+void SnapshotWriter::WriteBytes(const void* data, size_t size) {
+    output_.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    offset_ += size;
+}
+
+void SnapshotWriter::Align() {
+    static const char padding[ARRAY_ALIGNMENT] = {};
+    WriteBytes(padding, (ARRAY_ALIGNMENT - offset_ % ARRAY_ALIGNMENT) % ARRAY_ALIGNMENT);
+}
+
+void SnapshotReader::ReadHeader() {
+    if (Read<uint32_t>() != SNAPSHOT_MAGIC) {
+        throw std::runtime_error("Not a search server snapshot");
+    }
+    if (Read<uint32_t>() != SNAPSHOT_VERSION) {
+        throw std::runtime_error("Unsupported snapshot version");
+    }
+    if (Read<uint32_t>() != SNAPSHOT_BYTE_ORDER_MARK) {
+        throw std::runtime_error("Snapshot has a different byte order");
+    }
+}
+
+uint64_t SnapshotReader::ReadCount(size_t min_element_size) {
+    const uint64_t count = Read<uint64_t>();
+    if (count > (size_ - offset_) / min_element_size) {
+        throw std::runtime_error("Snapshot is truncated");
+    }
+    return count;
+}
+
+std::string_view SnapshotReader::ReadString() {
+    const uint64_t size = Read<uint64_t>();
+    if (size > size_ - offset_) {
+        throw std::runtime_error("Snapshot is truncated");
+    }
+    return { Take(size), size };
+}
+
+const char* SnapshotReader::Take(size_t size) {
+    if (size > size_ - offset_) {
+        throw std::runtime_error("Snapshot is truncated");
+    }
+    const char* data = data_ + offset_;
+    offset_ += size;
+    return data;
+}
+
+void SnapshotReader::Align() {
+    const size_t alignment = SnapshotWriter::ARRAY_ALIGNMENT;
+    Take((alignment - offset_ % alignment) % alignment);
+}
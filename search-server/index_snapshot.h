@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+
+// Binary snapshot encoding. Values are stored in native byte order, and
+// arrays start at offsets aligned to ARRAY_ALIGNMENT, so a reader over a
+// memory-mapped snapshot can use them in place.
+inline const uint32_t SNAPSHOT_MAGIC = 0x50414E53;  // "SNAP"
+inline const uint32_t SNAPSHOT_VERSION = 1;
+inline const uint32_t SNAPSHOT_BYTE_ORDER_MARK = 0x01020304;
+
+class SnapshotWriter {
+public:
+    inline static const size_t ARRAY_ALIGNMENT = 8;
+
+    explicit SnapshotWriter(std::ostream& output)
+        : output_(output) {
+    }
+
+    void WriteHeader();
+
+    template <typename T>
+    void Write(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        WriteBytes(&value, sizeof(T));
+    }
+
+    void WriteString(std::string_view text);
+
+    template <typename T>
+    void WriteArray(const T* values, size_t size) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        Align();
+        WriteBytes(values, size * sizeof(T));
+    }
+
+private:
+    void WriteBytes(const void* data, size_t size);
+
+    void Align();
+
+    std::ostream& output_;
+    size_t offset_ = 0;
+};
+
+// Reads a snapshot from memory; throws std::runtime_error if the data
+// is not a snapshot of the supported version or is truncated
+class SnapshotReader {
+public:
+    SnapshotReader(const char* data, size_t size)
+        : data_(data)
+        , size_(size) {
+    }
+
+    void ReadHeader();
+
+    template <typename T>
+    T Read() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        std::memcpy(&value, Take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    // Reads the number of elements that follow, each taking at least
+    // min_element_size bytes
+    uint64_t ReadCount(size_t min_element_size);
+
+    // The view points into the snapshot data
+    std::string_view ReadString();
+
+    // The array points into the snapshot data
+    template <typename T>
+    const T* ReadArray(size_t size) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        Align();
+        if (size > (size_ - offset_) / sizeof(T)) {
+            throw std::runtime_error("Snapshot is truncated");
+        }
+        return reinterpret_cast<const T*>(Take(size * sizeof(T)));
+    }
+
+private:
+    const char* Take(size_t size);
+
+    void Align();
+
+    const char* data_;
+    size_t size_;
+    size_t offset_ = 0;
+};
@@ -0,0 +1,405 @@
+#include "inverted_index.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+double FindMaxTermFreq(const std::vector<double>& term_freqs) {
+    return term_freqs.empty() ? 0.0 : *std::max_element(term_freqs.begin(), term_freqs.end());
+}
+
+}  // namespace
+
+std::shared_ptr<const SealedPostings> SealedPostings::MakePlain(std::vector<int> document_ids,
+    std::vector<int> ordinals, std::vector<double> term_freqs) {
+    auto sealed = std::make_shared<SealedPostings>();
+    sealed->max_term_freq_ = FindMaxTermFreq(term_freqs);
+    sealed->ordinals_ = std::move(ordinals);
+    sealed->owned_document_ids_ = std::move(document_ids);
+    sealed->owned_term_freqs_ = std::move(term_freqs);
+    sealed->document_ids_ = sealed->owned_document_ids_.data();
+    sealed->term_freqs_ = sealed->owned_term_freqs_.data();
+    sealed->size_ = sealed->owned_document_ids_.size();
+    return sealed;
+}
+
+std::shared_ptr<const SealedPostings> SealedPostings::MakeCompressed(const std::vector<int>& document_ids,
+    const std::vector<int>& ordinals, const std::vector<double>& term_freqs) {
+    auto sealed = std::make_shared<SealedPostings>();
+    sealed->compressed_ = true;
+    sealed->max_term_freq_ = FindMaxTermFreq(term_freqs);
+    sealed->compressed_postings_ = CompressedPostings(document_ids, ordinals, term_freqs);
+    return sealed;
+}
+
+std::shared_ptr<const SealedPostings> SealedPostings::MakeBorrowed(const int* document_ids,
+    std::vector<int> ordinals, const double* term_freqs, size_t size, double max_term_freq,
+    std::shared_ptr<const void> owner) {
+    auto sealed = std::make_shared<SealedPostings>();
+    sealed->max_term_freq_ = max_term_freq;
+    sealed->ordinals_ = std::move(ordinals);
+    sealed->document_ids_ = document_ids;
+    sealed->term_freqs_ = term_freqs;
+    sealed->size_ = size;
+    sealed->owner_ = std::move(owner);
+    return sealed;
+}
+
+bool SealedPostings::Contains(int document_id) const {
+    if (compressed_) {
+        return compressed_postings_.Contains(document_id);
+    }
+    return std::binary_search(document_ids_, document_ids_ + size_, document_id);
+}
+
+size_t SealedPostings::GetMemoryUsage() const {
+    return sizeof(SealedPostings)
+        + ordinals_.capacity() * sizeof(int)
+        + owned_document_ids_.capacity() * sizeof(int)
+        + owned_term_freqs_.capacity() * sizeof(double)
+        + compressed_postings_.GetMemoryUsage();
+}
+
+void PostingList::Add(int document_id, int ordinal, double term_freq) {
+    max_term_freq_ = std::max(max_term_freq_, term_freq);
+    const auto pos = std::lower_bound(pending_ids_.begin(), pending_ids_.end(), document_id) - pending_ids_.begin();
+    pending_ids_.insert(pending_ids_.begin() + pos, document_id);
+    pending_ordinals_.insert(pending_ordinals_.begin() + pos, ordinal);
+    pending_freqs_.insert(pending_freqs_.begin() + pos, term_freq);
+}
+
+void PostingList::Add(const TermPosting* first, const TermPosting* last) {
+    for (const TermPosting* posting = first; posting != last; ++posting) {
+        max_term_freq_ = std::max(max_term_freq_, posting->term_freq);
+    }
+
+    std::vector<int> pending_ids;
+    std::vector<int> pending_ordinals;
+    std::vector<double> pending_freqs;
+    pending_ids.reserve(pending_ids_.size() + (last - first));
+    pending_ordinals.reserve(pending_ids_.size() + (last - first));
+    pending_freqs.reserve(pending_ids_.size() + (last - first));
+    size_t pending_index = 0;
+    for (const TermPosting* posting = first; posting != last; ++posting) {
+        while (pending_index < pending_ids_.size() && pending_ids_[pending_index] < posting->document_id) {
+            pending_ids.push_back(pending_ids_[pending_index]);
+            pending_ordinals.push_back(pending_ordinals_[pending_index]);
+            pending_freqs.push_back(pending_freqs_[pending_index]);
+            ++pending_index;
+        }
+        pending_ids.push_back(posting->document_id);
+        pending_ordinals.push_back(posting->ordinal);
+        pending_freqs.push_back(posting->term_freq);
+    }
+    pending_ids.insert(pending_ids.end(), pending_ids_.begin() + pending_index, pending_ids_.end());
+    pending_ordinals.insert(pending_ordinals.end(), pending_ordinals_.begin() + pending_index, pending_ordinals_.end());
+    pending_freqs.insert(pending_freqs.end(), pending_freqs_.begin() + pending_index, pending_freqs_.end());
+    pending_ids_ = std::move(pending_ids);
+    pending_ordinals_ = std::move(pending_ordinals);
+    pending_freqs_ = std::move(pending_freqs);
+}
+
+bool PostingList::Remove(int document_id) {
+    const auto pending_it = std::lower_bound(pending_ids_.begin(), pending_ids_.end(), document_id);
+    if (pending_it != pending_ids_.end() && *pending_it == document_id) {
+        const auto pos = pending_it - pending_ids_.begin();
+        pending_ids_.erase(pending_it);
+        pending_ordinals_.erase(pending_ordinals_.begin() + pos);
+        pending_freqs_.erase(pending_freqs_.begin() + pos);
+        return true;
+    }
+
+    if (sealed_ == nullptr || !sealed_->Contains(document_id)) {
+        return false;
+    }
+    const auto removed_it = std::lower_bound(removed_ids_.begin(), removed_ids_.end(), document_id);
+    if (removed_it != removed_ids_.end() && *removed_it == document_id) {
+        return false;
+    }
+    removed_ids_.insert(removed_it, document_id);
+    return true;
+}
+
+void PostingList::Remove(const int* first, const int* last) {
+    // Ids that are not pending may be sealed
+    std::vector<int> sealed_ids;
+    size_t kept = 0;
+    const int* id = first;
+    for (size_t i = 0; i < pending_ids_.size(); ++i) {
+        for (; id != last && *id < pending_ids_[i]; ++id) {
+            sealed_ids.push_back(*id);
+        }
+        if (id != last && *id == pending_ids_[i]) {
+            ++id;
+            continue;
+        }
+        pending_ids_[kept] = pending_ids_[i];
+        pending_ordinals_[kept] = pending_ordinals_[i];
+        pending_freqs_[kept] = pending_freqs_[i];
+        ++kept;
+    }
+    sealed_ids.insert(sealed_ids.end(), id, last);
+    pending_ids_.resize(kept);
+    pending_ordinals_.resize(kept);
+    pending_freqs_.resize(kept);
+
+    if (sealed_ == nullptr) {
+        return;
+    }
+    sealed_ids.erase(std::remove_if(sealed_ids.begin(), sealed_ids.end(), [this](int document_id) {
+        return !sealed_->Contains(document_id);
+    }), sealed_ids.end());
+    std::vector<int> removed_ids;
+    removed_ids.reserve(removed_ids_.size() + sealed_ids.size());
+    std::set_union(removed_ids_.begin(), removed_ids_.end(), sealed_ids.begin(), sealed_ids.end(),
+        std::back_inserter(removed_ids));
+    removed_ids_ = std::move(removed_ids);
+}
+
+bool PostingList::Contains(int document_id) const {
+    if (std::binary_search(pending_ids_.begin(), pending_ids_.end(), document_id)) {
+        return true;
+    }
+    return sealed_ != nullptr && sealed_->Contains(document_id)
+        && !std::binary_search(removed_ids_.begin(), removed_ids_.end(), document_id);
+}
+
+void PostingList::Compact() {
+    const bool relayout = sealed_ != nullptr && sealed_->IsCompressed() != compressed_;
+    if (GetBufferedChangeCount() == 0 && !relayout) {
+        return;
+    }
+    sealed_ = Merge(compressed_);
+    max_term_freq_ = sealed_->GetMaxTermFreq();
+    pending_ids_.clear();
+    pending_ordinals_.clear();
+    pending_freqs_.clear();
+    removed_ids_.clear();
+    // A running background merge is outdated now
+    merge_id_ = 0;
+}
+
+void PostingList::SetRepresentation(IndexRepresentation representation) {
+    compressed_ = representation == IndexRepresentation::COMPRESSED;
+    Compact();
+}
+
+void PostingList::AttachSealed(const int* document_ids, std::vector<int> ordinals, const double* term_freqs,
+    size_t size, double max_term_freq, std::shared_ptr<const void> owner) {
+    *this = PostingList();
+    sealed_ = SealedPostings::MakeBorrowed(document_ids, std::move(ordinals), term_freqs, size, max_term_freq,
+        std::move(owner));
+    max_term_freq_ = max_term_freq;
+}
+
+size_t PostingList::GetMemoryUsage() const {
+    return (sealed_ != nullptr ? sealed_->GetMemoryUsage() : 0)
+        + pending_ids_.capacity() * sizeof(int)
+        + pending_ordinals_.capacity() * sizeof(int)
+        + pending_freqs_.capacity() * sizeof(double)
+        + removed_ids_.capacity() * sizeof(int);
+}
+
+std::shared_ptr<const SealedPostings> PostingList::Merge(bool compressed) const {
+    std::vector<int> document_ids;
+    std::vector<int> ordinals;
+    std::vector<double> term_freqs;
+    document_ids.reserve(size());
+    ordinals.reserve(size());
+    term_freqs.reserve(size());
+    for (Iterator posting = begin(); posting != end(); ++posting) {
+        const auto [document_id, term_freq] = *posting;
+        document_ids.push_back(document_id);
+        ordinals.push_back(posting.Ordinal());
+        term_freqs.push_back(term_freq);
+    }
+    if (compressed) {
+        return SealedPostings::MakeCompressed(document_ids, ordinals, term_freqs);
+    }
+    return SealedPostings::MakePlain(std::move(document_ids), std::move(ordinals), std::move(term_freqs));
+}
+
+void PostingList::InstallMerge(std::shared_ptr<const SealedPostings> merged, const PostingList& base) {
+    // Buffered postings of base are sealed now. Those removed since become
+    // tombstones, and those replaced since stay buffered over a tombstone.
+    std::vector<int> pending_ids;
+    std::vector<int> pending_ordinals;
+    std::vector<double> pending_freqs;
+    std::vector<int> tombstones;
+    size_t base_index = 0;
+    size_t index = 0;
+    while (base_index < base.pending_ids_.size() || index < pending_ids_.size()) {
+        if (index == pending_ids_.size()
+            || (base_index < base.pending_ids_.size() && base.pending_ids_[base_index] < pending_ids_[index])) {
+            tombstones.push_back(base.pending_ids_[base_index++]);
+        }
+        else if (base_index == base.pending_ids_.size() || pending_ids_[index] < base.pending_ids_[base_index]) {
+            pending_ids.push_back(pending_ids_[index]);
+            pending_ordinals.push_back(pending_ordinals_[index]);
+            pending_freqs.push_back(pending_freqs_[index++]);
+        }
+        else {
+            // A document added again may have got another ordinal
+            if (pending_freqs_[index] != base.pending_freqs_[base_index]
+                || pending_ordinals_[index] != base.pending_ordinals_[base_index]) {
+                tombstones.push_back(base.pending_ids_[base_index]);
+                pending_ids.push_back(pending_ids_[index]);
+                pending_ordinals.push_back(pending_ordinals_[index]);
+                pending_freqs.push_back(pending_freqs_[index]);
+            }
+            ++base_index;
+            ++index;
+        }
+    }
+
+    // Tombstones of base were applied by the merge, and tombstones added
+    // since refer to postings of the old sealed postings, which are in the
+    // merged ones as well
+    std::vector<int> removed_since;
+    std::set_difference(removed_ids_.begin(), removed_ids_.end(), base.removed_ids_.begin(), base.removed_ids_.end(),
+        std::back_inserter(removed_since));
+    removed_ids_.clear();
+    std::set_union(removed_since.begin(), removed_since.end(), tombstones.begin(), tombstones.end(),
+        std::back_inserter(removed_ids_));
+
+    sealed_ = std::move(merged);
+    pending_ids_ = std::move(pending_ids);
+    pending_ordinals_ = std::move(pending_ordinals);
+    pending_freqs_ = std::move(pending_freqs);
+    max_term_freq_ = std::max(sealed_->GetMaxTermFreq(), FindMaxTermFreq(pending_freqs_));
+    merge_id_ = 0;
+}
+
+void InvertedIndex::Add(TermId term_id, int document_id, int ordinal, double term_freq) {
+    InstallMerges();
+    if (term_id >= postings_.size()) {
+        postings_.resize(term_id + 1);
+    }
+    PostingList& postings = postings_[term_id];
+    if (postings.empty()) {
+        postings.SetRepresentation(representation_);
+    }
+    postings.Add(document_id, ordinal, term_freq);
+    MergeIfNeeded(term_id);
+}
+
+void InvertedIndex::Remove(TermId term_id, int document_id) {
+    InstallMerges();
+    RemovePosting(term_id, document_id);
+    MergeIfNeeded(term_id);
+}
+
+const PostingList* InvertedIndex::Find(TermId term_id) const {
+    if (term_id >= postings_.size() || postings_[term_id].empty()) {
+        return nullptr;
+    }
+    return &postings_[term_id];
+}
+
+bool InvertedIndex::Contains(TermId term_id, int document_id) const {
+    const PostingList* postings = Find(term_id);
+    return postings != nullptr && postings->Contains(document_id);
+}
+
+void InvertedIndex::AttachSealed(TermId term_id, const int* document_ids, std::vector<int> ordinals,
+    const double* term_freqs, size_t size, double max_term_freq, std::shared_ptr<const void> owner) {
+    InstallMerges();
+    if (term_id >= postings_.size()) {
+        postings_.resize(term_id + 1);
+    }
+    postings_[term_id].AttachSealed(document_ids, std::move(ordinals), term_freqs, size, max_term_freq,
+        std::move(owner));
+    if (representation_ != IndexRepresentation::PLAIN) {
+        postings_[term_id].SetRepresentation(representation_);
+    }
+}
+
+void InvertedIndex::SetRepresentation(IndexRepresentation representation) {
+    InstallMerges();
+    representation_ = representation;
+    for (PostingList& postings : postings_) {
+        postings.SetRepresentation(representation);
+    }
+}
+
+void InvertedIndex::SetBackgroundMerging(bool enabled) {
+    FinishMerges();
+    background_merging_ = enabled;
+}
+
+void InvertedIndex::FinishMerges() {
+    if (merge_queue_ != nullptr) {
+        merge_queue_->worker.WaitIdle();
+    }
+    InstallMerges();
+}
+
+size_t InvertedIndex::GetMemoryUsage() const {
+    size_t memory_usage = postings_.capacity() * sizeof(PostingList);
+    for (const PostingList& postings : postings_) {
+        memory_usage += postings.GetMemoryUsage();
+    }
+    return memory_usage;
+}
+
+void InvertedIndex::InstallMerges() {
+    if (merge_queue_ == nullptr) {
+        return;
+    }
+    std::vector<MergeResult> results;
+    {
+        const std::lock_guard guard(merge_queue_->mutex);
+        results.swap(merge_queue_->results);
+    }
+    for (MergeResult& result : results) {
+        // The list may have been compacted, emptied or reused by another term since
+        if (result.term_id < postings_.size() && postings_[result.term_id].merge_id_ == result.merge_id) {
+            postings_[result.term_id].InstallMerge(std::move(result.merged), result.base);
+            MergeIfNeeded(result.term_id);
+        }
+    }
+}
+
+void InvertedIndex::RemovePosting(TermId term_id, int document_id) {
+    if (term_id >= postings_.size()) {
+        return;
+    }
+    PostingList& postings = postings_[term_id];
+    postings.Remove(document_id);
+    if (postings.empty()) {
+        // The term id may be reused for another word, so drop the buffers
+        postings = PostingList();
+    }
+}
+
+void InvertedIndex::MergeIfNeeded(TermId term_id) {
+    if (term_id >= postings_.size()) {
+        return;
+    }
+    PostingList& postings = postings_[term_id];
+    const size_t change_count = postings.GetBufferedChangeCount();
+    const size_t threshold = postings.GetMergeThreshold();
+    if (change_count <= threshold) {
+        return;
+    }
+    // Falls back to merging inline if the merge thread does not keep up
+    if (!background_merging_ || change_count > threshold * PostingList::MAX_MERGE_BACKLOG) {
+        postings.Compact();
+        return;
+    }
+    if (postings.merge_id_ != 0) {
+        return;
+    }
+
+    if (merge_queue_ == nullptr) {
+        merge_queue_ = std::make_unique<MergeQueue>();
+    }
+    const uint64_t merge_id = ++merge_queue_->last_merge_id;
+    postings.merge_id_ = merge_id;
+    merge_queue_->worker.Submit([queue = merge_queue_.get(), term_id, merge_id, base = postings]() {
+        auto merged = base.Merge(base.compressed_);
+        const std::lock_guard guard(queue->mutex);
+        queue->results.push_back({ term_id, merge_id, base, std::move(merged) });
+    });
+}
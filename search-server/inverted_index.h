@@ -0,0 +1,619 @@
+#pragma once
+
+#include "compressed_postings.h"
+#include "term_dictionary.h"
+#include "worker_thread.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Storage of the compacted part of posting lists
+enum class IndexRepresentation {
+    PLAIN,
+    COMPRESSED,
+};
+
+// Occurrence of a term in a document, the unit of batch indexing
+struct TermPosting {
+    TermId term_id;
+    int document_id;
+    // Ordinal of the document in the document attributes
+    int ordinal;
+    double term_freq;
+};
+
+// Immutable compacted postings of a word: plain arrays, arrays owned by
+// someone else (e.g. a mapped snapshot) or compressed blocks. Sealed
+// postings are shared between a posting list and its background merges.
+class SealedPostings {
+public:
+    // document_ids must be sorted in ascending order
+    static std::shared_ptr<const SealedPostings> MakePlain(std::vector<int> document_ids,
+        std::vector<int> ordinals, std::vector<double> term_freqs);
+
+    static std::shared_ptr<const SealedPostings> MakeCompressed(const std::vector<int>& document_ids,
+        const std::vector<int>& ordinals, const std::vector<double>& term_freqs);
+
+    // The arrays of ids and frequencies stay valid while owner is alive
+    static std::shared_ptr<const SealedPostings> MakeBorrowed(const int* document_ids, std::vector<int> ordinals,
+        const double* term_freqs, size_t size, double max_term_freq, std::shared_ptr<const void> owner);
+
+    size_t size() const {
+        return compressed_ ? compressed_postings_.size() : size_;
+    }
+
+    bool IsCompressed() const {
+        return compressed_;
+    }
+
+    double GetMaxTermFreq() const {
+        return max_term_freq_;
+    }
+
+    // Plain layout only
+    const int* GetDocumentIds() const {
+        return document_ids_;
+    }
+
+    const int* GetOrdinals() const {
+        return ordinals_.data();
+    }
+
+    const double* GetTermFreqs() const {
+        return term_freqs_;
+    }
+
+    // Compressed layout only
+    const CompressedPostings& GetCompressedPostings() const {
+        return compressed_postings_;
+    }
+
+    bool Contains(int document_id) const;
+
+    // Heap memory owned by the postings
+    size_t GetMemoryUsage() const;
+
+private:
+    bool compressed_ = false;
+    const int* document_ids_ = nullptr;
+    const double* term_freqs_ = nullptr;
+    size_t size_ = 0;
+    double max_term_freq_ = 0.0;
+    // Plain layout, borrowed arrays included
+    std::vector<int> ordinals_;
+    std::vector<int> owned_document_ids_;
+    std::vector<double> owned_term_freqs_;
+    CompressedPostings compressed_postings_;
+    std::shared_ptr<const void> owner_;
+};
+
+// Postings of a single word, kept like a small LSM tree: sealed postings,
+// a sorted buffer of added postings and sorted tombstones of removed sealed
+// postings. Merging folds the buffer and the tombstones into new sealed
+// postings; it runs on a background thread of the index (see InvertedIndex)
+// or inline in Compact(). Every posting also keeps the ordinal of its
+// document, so scoring needs no lookup by document id.
+class PostingList {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<int, double>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        Iterator(const PostingList* postings, size_t index, size_t pending_index, size_t removed_index)
+            : postings_(postings)
+            , sealed_(postings->sealed_.get())
+            , sealed_size_(postings->GetSealedSize())
+            , compressed_(sealed_ != nullptr && sealed_->IsCompressed())
+            , ids_(sealed_ != nullptr ? sealed_->GetDocumentIds() : nullptr)
+            , ordinals_(sealed_ != nullptr ? sealed_->GetOrdinals() : nullptr)
+            , freqs_(sealed_ != nullptr ? sealed_->GetTermFreqs() : nullptr)
+            , pending_index_(pending_index)
+            , removed_index_(removed_index) {
+            Seek(index);
+            SkipRemoved();
+        }
+
+        value_type operator*() const {
+            if (IsPending()) {
+                return { postings_->pending_ids_[pending_index_], postings_->pending_freqs_[pending_index_] };
+            }
+            return { SealedId(), SealedFreq() };
+        }
+
+        // Ordinal of the document of the current posting
+        int Ordinal() const {
+            if (IsPending()) {
+                return postings_->pending_ordinals_[pending_index_];
+            }
+            if (compressed_) {
+                return block_.GetOrdinals()[index_ - block_begin_];
+            }
+            return ordinals_[index_];
+        }
+
+        Iterator& operator++() {
+            if (IsPending()) {
+                ++pending_index_;
+            }
+            else {
+                Seek(index_ + 1);
+                SkipRemoved();
+            }
+            return *this;
+        }
+
+        // Moves to the first posting whose document id is not less than document_id
+        void SkipTo(int document_id) {
+            if (compressed_) {
+                SkipSealedToCompressed(document_id);
+            }
+            else if (ids_ != nullptr) {
+                index_ = std::lower_bound(ids_ + index_, ids_ + sealed_size_, document_id) - ids_;
+            }
+            const auto& pending_ids = postings_->pending_ids_;
+            const auto& removed = postings_->removed_ids_;
+            pending_index_ = std::lower_bound(pending_ids.begin() + pending_index_, pending_ids.end(), document_id)
+                - pending_ids.begin();
+            removed_index_ = std::lower_bound(removed.begin() + removed_index_, removed.end(), document_id)
+                - removed.begin();
+            SkipRemoved();
+        }
+
+        Iterator operator++(int) {
+            Iterator result = *this;
+            ++*this;
+            return result;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return index_ == other.index_ && pending_index_ == other.pending_index_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        static const size_t BLOCK_SIZE = CompressedPostings::BLOCK_SIZE;
+
+        // Decoded block of compressed postings, allocated by the first decoding,
+        // so iterators over plain lists stay small. A copy of an iterator gets
+        // its own buffer, as either of them may move on to another block.
+        class BlockBuffer {
+        public:
+            BlockBuffer() = default;
+
+            BlockBuffer(const BlockBuffer& other)
+                : block_(other.block_ ? std::make_unique<Block>(*other.block_) : nullptr) {
+            }
+
+            BlockBuffer& operator=(const BlockBuffer& other) {
+                if (!other.block_) {
+                    block_.reset();
+                }
+                else if (block_) {
+                    *block_ = *other.block_;
+                }
+                else {
+                    block_ = std::make_unique<Block>(*other.block_);
+                }
+                return *this;
+            }
+
+            BlockBuffer(BlockBuffer&&) = default;
+            BlockBuffer& operator=(BlockBuffer&&) = default;
+
+            int* GetIds() {
+                return Get().ids.data();
+            }
+
+            const int* GetIds() const {
+                return block_->ids.data();
+            }
+
+            int* GetOrdinals() {
+                return Get().ordinals.data();
+            }
+
+            const int* GetOrdinals() const {
+                return block_->ordinals.data();
+            }
+
+            double* GetFreqs() {
+                return Get().freqs.data();
+            }
+
+            const double* GetFreqs() const {
+                return block_->freqs.data();
+            }
+
+        private:
+            struct Block {
+                std::array<int, BLOCK_SIZE> ids;
+                std::array<int, BLOCK_SIZE> ordinals;
+                std::array<double, BLOCK_SIZE> freqs;
+            };
+
+            Block& Get() {
+                if (!block_) {
+                    block_ = std::make_unique<Block>();
+                }
+                return *block_;
+            }
+
+            std::unique_ptr<Block> block_;
+        };
+
+        int SealedId() const {
+            if (compressed_) {
+                return block_.GetIds()[index_ - block_begin_];
+            }
+            return ids_[index_];
+        }
+
+        double SealedFreq() const {
+            if (compressed_) {
+                return block_.GetFreqs()[index_ - block_begin_];
+            }
+            return freqs_[index_];
+        }
+
+        // Moves within the sealed postings, decoding the block of the new position
+        void Seek(size_t index) {
+            index_ = index;
+            if (compressed_ && index_ < sealed_size_
+                && (index_ < block_begin_ || index_ >= block_begin_ + block_size_)) {
+                LoadBlock(index_ / BLOCK_SIZE);
+            }
+        }
+
+        void LoadBlock(size_t block) {
+            block_begin_ = block * BLOCK_SIZE;
+            block_size_ = sealed_->GetCompressedPostings().DecodeBlock(block, block_.GetIds(), block_.GetOrdinals(),
+                block_.GetFreqs());
+        }
+
+        void SkipSealedToCompressed(int document_id) {
+            const CompressedPostings& compressed = sealed_->GetCompressedPostings();
+            if (index_ == compressed.size()) {
+                return;
+            }
+            const size_t block = compressed.FindBlock(document_id, index_ / BLOCK_SIZE);
+            if (block == compressed.GetBlockCount()) {
+                index_ = compressed.size();
+                return;
+            }
+            if (block * BLOCK_SIZE != block_begin_) {
+                LoadBlock(block);
+            }
+            const size_t from = std::max(index_, block_begin_) - block_begin_;
+            const int* block_ids = block_.GetIds();
+            index_ = block_begin_ + (std::lower_bound(block_ids + from, block_ids + block_size_, document_id)
+                - block_ids);
+        }
+
+        bool IsPending() const {
+            if (pending_index_ == postings_->pending_ids_.size()) {
+                return false;
+            }
+            return index_ == sealed_size_
+                || postings_->pending_ids_[pending_index_] < SealedId();
+        }
+
+        void SkipRemoved() {
+            const auto& removed = postings_->removed_ids_;
+            while (index_ < sealed_size_ && removed_index_ < removed.size()) {
+                const int document_id = SealedId();
+                if (removed[removed_index_] < document_id) {
+                    ++removed_index_;
+                }
+                else if (removed[removed_index_] == document_id) {
+                    ++removed_index_;
+                    Seek(index_ + 1);
+                }
+                else {
+                    break;
+                }
+            }
+        }
+
+        const PostingList* postings_;
+        const SealedPostings* sealed_;
+        size_t sealed_size_;
+        bool compressed_;
+        // Plain sealed postings
+        const int* ids_;
+        const int* ordinals_;
+        const double* freqs_;
+        size_t index_ = 0;
+        size_t pending_index_;
+        size_t removed_index_;
+        // Decoded block of compressed sealed postings
+        size_t block_begin_ = 0;
+        size_t block_size_ = 0;
+        BlockBuffer block_;
+    };
+
+    // The document must not already be present in the list
+    void Add(int document_id, int ordinal, double term_freq);
+
+    // Adds postings sorted by document id, none of which is present in the list
+    void Add(const TermPosting* first, const TermPosting* last);
+
+    bool Remove(int document_id);
+
+    // Removes the documents with ids in the sorted range; absent ones are skipped
+    void Remove(const int* first, const int* last);
+
+    bool Contains(int document_id) const;
+
+    size_t size() const {
+        return GetSealedSize() - removed_ids_.size() + pending_ids_.size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // Upper bound of the term frequencies in the list
+    double max_term_freq() const {
+        return max_term_freq_;
+    }
+
+    Iterator begin() const {
+        return Iterator(this, 0, 0, 0);
+    }
+
+    Iterator end() const {
+        return Iterator(this, GetSealedSize(), pending_ids_.size(), removed_ids_.size());
+    }
+
+    // Merges the buffered changes into the sealed postings
+    void Compact();
+
+    // Converts the list, compacting it on the way
+    void SetRepresentation(IndexRepresentation representation);
+
+    // Makes the list consist of the given sealed postings. The arrays of ids
+    // and frequencies stay valid while owner is alive and are copied by the
+    // first merge.
+    void AttachSealed(const int* document_ids, std::vector<int> ordinals, const double* term_freqs, size_t size,
+        double max_term_freq, std::shared_ptr<const void> owner);
+
+    // Heap memory of the list; sealed postings shared with a running merge are counted too
+    size_t GetMemoryUsage() const;
+
+private:
+    friend class InvertedIndex;
+
+    inline static const size_t MIN_MERGE_THRESHOLD = 32;
+    // Bound of the buffered changes relative to the merge threshold while a
+    // background merge is running
+    inline static const size_t MAX_MERGE_BACKLOG = 4;
+
+    size_t GetSealedSize() const {
+        return sealed_ != nullptr ? sealed_->size() : 0;
+    }
+
+    size_t GetMergeThreshold() const {
+        return std::max(MIN_MERGE_THRESHOLD, GetSealedSize() / 8);
+    }
+
+    size_t GetBufferedChangeCount() const {
+        return pending_ids_.size() + removed_ids_.size();
+    }
+
+    // Sealed postings with the contents of the whole list
+    std::shared_ptr<const SealedPostings> Merge(bool compressed) const;
+
+    // Replaces the sealed postings with the result of merging base, a copy
+    // of the list taken when the merge started. Changes made since then stay
+    // buffered.
+    void InstallMerge(std::shared_ptr<const SealedPostings> merged, const PostingList& base);
+
+    bool compressed_ = false;
+    std::shared_ptr<const SealedPostings> sealed_;
+    std::vector<int> pending_ids_;
+    std::vector<int> pending_ordinals_;
+    std::vector<double> pending_freqs_;
+    std::vector<int> removed_ids_;
+    double max_term_freq_ = 0.0;
+    // Id of the background merge of the list, 0 if none is running
+    uint64_t merge_id_ = 0;
+};
+
+// Posting lists indexed by term id.
+// Posting lists that have buffered enough changes are merged on a
+// background thread owned by the index. A finished merge is installed by
+// the next change of the index, so queries, which do not change the index,
+// never observe it; they read the buffered changes until then.
+class InvertedIndex {
+public:
+    void Add(TermId term_id, int document_id, int ordinal, double term_freq);
+
+    void Remove(TermId term_id, int document_id);
+
+    // Adds the postings of many documents at once. Postings are grouped by
+    // term, and the posting list of every term is filled independently.
+    template <typename ExecutionPolicy>
+    void Add(const ExecutionPolicy& policy, std::vector<TermPosting>& postings);
+
+    // Removes the document from the postings of all given terms. Every term
+    // occurs in the vector at most once, so posting lists are updated independently.
+    template <typename ExecutionPolicy>
+    void Remove(const ExecutionPolicy& policy, const std::vector<TermId>& term_ids, int document_id);
+
+    // Removes many documents at once. Postings are grouped by term, every
+    // posting list drops all its documents in one pass, and the lists are
+    // updated independently; ordinals and term frequencies of the postings
+    // are ignored.
+    template <typename ExecutionPolicy>
+    void Remove(const ExecutionPolicy& policy, std::vector<TermPosting>& postings);
+
+    // Returns nullptr if the term does not occur in any document
+    const PostingList* Find(TermId term_id) const;
+
+    bool Contains(TermId term_id, int document_id) const;
+
+    // See PostingList::AttachSealed()
+    void AttachSealed(TermId term_id, const int* document_ids, std::vector<int> ordinals, const double* term_freqs,
+        size_t size, double max_term_freq, std::shared_ptr<const void> owner);
+
+    // Converts all posting lists; lists created later use the same representation
+    void SetRepresentation(IndexRepresentation representation);
+
+    IndexRepresentation GetRepresentation() const {
+        return representation_;
+    }
+
+    // With background merging disabled, posting lists are merged inline by
+    // the change that fills their buffers
+    void SetBackgroundMerging(bool enabled);
+
+    // Waits for the running background merges and installs their results
+    void FinishMerges();
+
+    size_t GetMemoryUsage() const;
+
+private:
+    struct MergeResult {
+        TermId term_id;
+        uint64_t merge_id;
+        PostingList base;
+        std::shared_ptr<const SealedPostings> merged;
+    };
+
+    // State shared with the merge thread
+    struct MergeQueue {
+        std::mutex mutex;
+        std::vector<MergeResult> results;
+        uint64_t last_merge_id = 0;
+        // Declared last, so it finishes its tasks before the results go away
+        WorkerThread worker;
+    };
+
+    // Installs the finished merges; every change of the index starts with it
+    void InstallMerges();
+
+    // Removes the posting without merging; safe to call for different terms concurrently
+    void RemovePosting(TermId term_id, int document_id);
+
+    // Starts merging the posting list of the term if it has buffered enough
+    // changes. Must not run concurrently with other changes of the index.
+    void MergeIfNeeded(TermId term_id);
+
+    std::vector<PostingList> postings_;
+    IndexRepresentation representation_ = IndexRepresentation::PLAIN;
+    bool background_merging_ = true;
+    // Created by the first background merge
+    std::unique_ptr<MergeQueue> merge_queue_;
+};
+
+template <typename ExecutionPolicy>
+void InvertedIndex::Add(const ExecutionPolicy& policy, std::vector<TermPosting>& postings) {
+    std::sort(
+        policy,
+        postings.begin(), postings.end(),
+        [](const TermPosting& lhs, const TermPosting& rhs) {
+            return std::tie(lhs.term_id, lhs.document_id) < std::tie(rhs.term_id, rhs.document_id);
+        }
+    );
+
+    // Ranges of postings sharing a term
+    std::vector<std::pair<size_t, size_t>> groups;
+    for (size_t i = 0; i < postings.size(); ++i) {
+        if (i == 0 || postings[i].term_id != postings[i - 1].term_id) {
+            groups.emplace_back(i, i);
+        }
+        ++groups.back().second;
+    }
+    InstallMerges();
+    if (!postings.empty() && postings.back().term_id >= postings_.size()) {
+        postings_.resize(postings.back().term_id + 1);
+    }
+
+    std::for_each(
+        policy,
+        groups.begin(), groups.end(),
+        [this, &postings](const std::pair<size_t, size_t>& group) {
+            PostingList& term_postings = postings_[postings[group.first].term_id];
+            if (term_postings.empty()) {
+                term_postings.SetRepresentation(representation_);
+            }
+            term_postings.Add(postings.data() + group.first, postings.data() + group.second);
+        }
+    );
+    for (const auto& [group_begin, group_end] : groups) {
+        MergeIfNeeded(postings[group_begin].term_id);
+    }
+}
+
+template <typename ExecutionPolicy>
+void InvertedIndex::Remove(const ExecutionPolicy& policy, std::vector<TermPosting>& postings) {
+    std::sort(
+        policy,
+        postings.begin(), postings.end(),
+        [](const TermPosting& lhs, const TermPosting& rhs) {
+            return std::tie(lhs.term_id, lhs.document_id) < std::tie(rhs.term_id, rhs.document_id);
+        }
+    );
+
+    // Ranges of postings sharing a term, with the document ids of each
+    // range stored contiguously
+    std::vector<std::pair<size_t, size_t>> groups;
+    std::vector<int> document_ids(postings.size());
+    for (size_t i = 0; i < postings.size(); ++i) {
+        if (i == 0 || postings[i].term_id != postings[i - 1].term_id) {
+            groups.emplace_back(i, i);
+        }
+        ++groups.back().second;
+        document_ids[i] = postings[i].document_id;
+    }
+    InstallMerges();
+
+    std::for_each(
+        policy,
+        groups.begin(), groups.end(),
+        [this, &postings, &document_ids](const std::pair<size_t, size_t>& group) {
+            const TermId term_id = postings[group.first].term_id;
+            if (term_id >= postings_.size()) {
+                return;
+            }
+            PostingList& term_postings = postings_[term_id];
+            term_postings.Remove(document_ids.data() + group.first, document_ids.data() + group.second);
+            if (term_postings.empty()) {
+                term_postings = PostingList();
+            }
+        }
+    );
+    for (const auto& [group_begin, group_end] : groups) {
+        MergeIfNeeded(postings[group_begin].term_id);
+    }
+}
+
+template <typename ExecutionPolicy>
+void InvertedIndex::Remove(const ExecutionPolicy& policy, const std::vector<TermId>& term_ids, int document_id) {
+    InstallMerges();
+    std::for_each(
+        policy,
+        term_ids.begin(), term_ids.end(),
+        [this, document_id](TermId term_id) {
+            RemovePosting(term_id, document_id);
+        }
+    );
+    for (const TermId term_id : term_ids) {
+        MergeIfNeeded(term_id);
+    }
+}
@@ -0,0 +1,58 @@
+#include "joined_documents.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void JoinedDocuments::Iterator::SkipFinishedQueries() {
+    while (query_ < owner_->GetQueryCount() && position_ == owner_->WaitForQuery(query_)) {
+        ++query_;
+        position_ = 0;
+    }
+}
+
+JoinedDocuments::JoinedDocuments(QueryExecutor& executor, size_t query_count, size_t max_result_count,
+    std::function<std::vector<Document>(size_t)> search)
+    : max_result_count_(max_result_count)
+    , documents_(query_count * max_result_count)
+    , document_counts_(MakePendingCounts(query_count))
+    , errors_(query_count)
+    , submission_(executor.Submit(query_count, [this, search = std::move(search)](size_t query) {
+        int document_count = FAILED;
+        try {
+            const std::vector<Document> found = search(query);
+            if (found.size() > max_result_count_) {
+                throw std::length_error("Query returned more than max_result_count documents");
+            }
+            std::copy(found.begin(), found.end(), documents_.begin() + query * max_result_count_);
+            document_count = static_cast<int>(found.size());
+        }
+        catch (...) {
+            errors_[query] = std::current_exception();
+        }
+        document_counts_[query].store(document_count, std::memory_order_release);
+        document_counts_[query].notify_all();
+    })) {
+}
+
+std::vector<std::atomic<int>> JoinedDocuments::MakePendingCounts(size_t query_count) {
+    std::vector<std::atomic<int>> document_counts(query_count);
+    for (std::atomic<int>& document_count : document_counts) {
+        document_count.store(PENDING, std::memory_order_relaxed);
+    }
+    return document_counts;
+}
+
+std::span<const Document> JoinedDocuments::GetQueryResults(size_t query) const {
+    const size_t document_count = WaitForQuery(query);
+    return { documents_.data() + query * max_result_count_, document_count };
+}
+
+size_t JoinedDocuments::WaitForQuery(size_t query) const {
+    const std::atomic<int>& document_count = document_counts_.at(query);
+    document_count.wait(PENDING, std::memory_order_acquire);
+    const int count = document_count.load(std::memory_order_acquire);
+    if (count == FAILED) {
+        std::rethrow_exception(errors_[query]);
+    }
+    return static_cast<size_t>(count);
+}
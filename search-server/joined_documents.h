@@ -0,0 +1,116 @@
+#pragma once
+
+#include "document.h"
+#include "query_executor.h"
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <span>
+#include <vector>
+
+// Results of a batch of queries joined in query order.
+// The queries run on the executor; iteration yields the documents of
+// each query as soon as it and all queries before it are done. Every query
+// owns a fixed slot of max_result_count documents in one buffer, so no
+// memory is allocated per document. An exception thrown by a query is
+// rethrown when iteration reaches that query.
+class JoinedDocuments {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Document;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Document*;
+        using reference = const Document&;
+
+        Iterator() = default;
+
+        reference operator*() const {
+            return owner_->documents_[query_ * owner_->max_result_count_ + position_];
+        }
+
+        pointer operator->() const {
+            return &**this;
+        }
+
+        Iterator& operator++() {
+            ++position_;
+            SkipFinishedQueries();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return query_ == other.query_ && position_ == other.position_;
+        }
+
+    private:
+        friend class JoinedDocuments;
+
+        Iterator(const JoinedDocuments* owner, size_t query)
+            : owner_(owner)
+            , query_(query) {
+        }
+
+        // Waits for the current query and moves past queries whose
+        // documents are exhausted
+        void SkipFinishedQueries();
+
+        const JoinedDocuments* owner_ = nullptr;
+        size_t query_ = 0;
+        size_t position_ = 0;
+    };
+
+    // Starts search(index) for every index in [0, query_count) on the
+    // executor; search must return at most max_result_count documents and
+    // everything it uses must outlive this object
+    JoinedDocuments(QueryExecutor& executor, size_t query_count, size_t max_result_count,
+        std::function<std::vector<Document>(size_t)> search);
+
+    JoinedDocuments(const JoinedDocuments&) = delete;
+    JoinedDocuments& operator=(const JoinedDocuments&) = delete;
+
+    Iterator begin() const {
+        Iterator it(this, 0);
+        it.SkipFinishedQueries();
+        return it;
+    }
+
+    Iterator end() const {
+        return Iterator(this, document_counts_.size());
+    }
+
+    size_t GetQueryCount() const {
+        return document_counts_.size();
+    }
+
+    // Waits for the query and returns its documents
+    std::span<const Document> GetQueryResults(size_t query) const;
+
+private:
+    inline static const int PENDING = -1;
+    inline static const int FAILED = -2;
+
+    static std::vector<std::atomic<int>> MakePendingCounts(size_t query_count);
+
+    // Waits for the query and returns its document count
+    size_t WaitForQuery(size_t query) const;
+
+    size_t max_result_count_;
+    std::vector<Document> documents_;
+    std::vector<std::atomic<int>> document_counts_;
+    // Written before the count of the query is published
+    std::vector<std::exception_ptr> errors_;
+    // Declared last, so destruction waits for the remaining queries before
+    // the buffers go away
+    QueryExecutor::Submission submission_;
+};
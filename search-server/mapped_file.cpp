@@ -0,0 +1,33 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open file " + path);
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("Cannot map file " + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Cannot map file " + path);
+    }
+    data_ = static_cast<const char*>(data);
+}
+
+MappedFile::~MappedFile() {
+    munmap(const_cast<char*>(data_), size_);
+}
@@ -1,28 +1,55 @@
 #include "process_queries.h"
+#include "query_metrics.h"
 
-#include <execution>
-#include <algorithm>
-#include <numeric>
+namespace {
 
-std::vector<std::vector<Document>> ProcessQueries(
-    const SearchServer& search_server,
+template <typename Server>
+std::vector<std::vector<Document>> ProcessQueriesOn(
+    QueryExecutor& executor,
+    const Server& search_server,
     const std::vector<std::string>& queries) {
     std::vector<std::vector<Document>> result(queries.size());
-    std::transform(
-        std::execution::par,
-        queries.cbegin(), queries.cend(),
-        result.begin(),
-        [&search_server](const std::string& query) { return std::move(search_server.FindTopDocuments(query)); });
+    executor.ForEach(queries.size(), [&](size_t index) {
+        PhaseTimer timer(QueryPhase::QUERY);
+        result[index] = search_server.FindTopDocuments(queries[index]);
+    });
     return result;
 }
 
-std::list<Document> ProcessQueriesJoined(
+}  // namespace
+
+std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
-    std::list<Document> result;
-    for (const std::vector<Document>& documents : ProcessQueries(search_server, queries))
-    {
-        std::move(documents.begin(), documents.end(), std::back_inserter(result));
-    }
-    return result;
+    return ProcessQueriesOn(QueryExecutor::GetDefault(), search_server, queries);
+}
+
+std::vector<std::vector<Document>> ProcessQueries(
+    QueryExecutor& executor,
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries) {
+    return ProcessQueriesOn(executor, search_server, queries);
+}
+
+std::vector<std::vector<Document>> ProcessQueries(
+    const ConcurrentSearchServer& search_server,
+    const std::vector<std::string>& queries) {
+    return ProcessQueriesOn(QueryExecutor::GetDefault(), search_server, queries);
+}
+
+JoinedDocuments ProcessQueriesJoined(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries) {
+    return ProcessQueriesJoined(QueryExecutor::GetDefault(), search_server, queries);
+}
+
+JoinedDocuments ProcessQueriesJoined(
+    QueryExecutor& executor,
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries) {
+    return JoinedDocuments(executor, queries.size(), MAX_RESULT_DOCUMENT_COUNT,
+        [&search_server, &queries](size_t index) {
+            PhaseTimer timer(QueryPhase::QUERY);
+            return search_server.FindTopDocuments(queries[index]);
+        });
 }
@@ -2,16 +2,36 @@
 
 #include "document.h"
 #include "search_server.h"
+#include "concurrent_search_server.h"
+#include "query_executor.h"
+#include "joined_documents.h"
 
 #include <vector>
 #include <string>
-#include <list>
 
 
+// Runs the queries on QueryExecutor::GetDefault()
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
 
-std::list<Document> ProcessQueriesJoined(
+std::vector<std::vector<Document>> ProcessQueries(
+    QueryExecutor& executor,
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
+// Every query reads the state published when it starts
+std::vector<std::vector<Document>> ProcessQueries(
+    const ConcurrentSearchServer& search_server,
+    const std::vector<std::string>& queries);
+
+// Documents of all queries in query order, available while later queries
+// are still running; search_server and queries must outlive the result
+JoinedDocuments ProcessQueriesJoined(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
+JoinedDocuments ProcessQueriesJoined(
+    QueryExecutor& executor,
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
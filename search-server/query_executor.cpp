@@ -0,0 +1,185 @@
+#include "query_executor.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+thread_local bool is_worker_thread = false;
+
+}  // namespace
+
+QueryExecutor::QueryExecutor(size_t worker_count) {
+    for (size_t i = 0; i <= worker_count; ++i) {
+        queues_.push_back(std::make_unique<WorkQueue>());
+    }
+    threads_.reserve(worker_count);
+    for (size_t worker = 0; worker < worker_count; ++worker) {
+        threads_.emplace_back([this, worker] {
+            RunWorker(worker);
+        });
+    }
+}
+
+QueryExecutor::~QueryExecutor() {
+    {
+        const std::lock_guard guard(sleep_mutex_);
+        stopping_ = true;
+    }
+    work_added_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+}
+
+bool QueryExecutor::IsWorkerThread() {
+    return is_worker_thread;
+}
+
+QueryExecutor& QueryExecutor::GetDefault() {
+    static QueryExecutor executor(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return executor;
+}
+
+QueryExecutor::Submission::~Submission() {
+    if (batch_) {
+        executor_->WaitForRanges(*batch_);
+    }
+}
+
+void QueryExecutor::Submission::Wait() {
+    executor_->Wait(*batch_);
+}
+
+void QueryExecutor::Start(Batch& batch, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    if (is_worker_thread || threads_.empty()) {
+        try {
+            batch.body(0, count);
+        }
+        catch (...) {
+            batch.error = std::current_exception();
+        }
+        return;
+    }
+
+    const size_t range_count = std::min(count, (threads_.size() + 1) * RANGES_PER_THREAD);
+    batch.remaining = range_count;
+    for (size_t i = 0; i < range_count; ++i) {
+        WorkQueue& queue = *queues_[i % queues_.size()];
+        const std::lock_guard guard(queue.mutex);
+        queue.ranges.push_back({ &batch, count * i / range_count, count * (i + 1) / range_count });
+    }
+    {
+        const std::lock_guard guard(sleep_mutex_);
+        queued_range_count_ += range_count;
+    }
+    work_added_.notify_all();
+}
+
+void QueryExecutor::Wait(Batch& batch) {
+    WaitForRanges(batch);
+    if (batch.error) {
+        std::rethrow_exception(batch.error);
+    }
+}
+
+void QueryExecutor::WaitForRanges(Batch& batch) {
+    // The waiting thread only helps with its own batch, so its latency
+    // does not include the queries of other callers
+    while (RunBatchRange(batch)) {
+    }
+    std::unique_lock lock(batch.mutex);
+    batch.done.wait(lock, [&batch] {
+        return batch.remaining == 0;
+    });
+}
+
+void QueryExecutor::RunWorker(size_t worker) {
+    is_worker_thread = true;
+    while (true) {
+        if (RunQueuedRange(worker)) {
+            continue;
+        }
+        std::unique_lock lock(sleep_mutex_);
+        work_added_.wait(lock, [this] {
+            return stopping_ || queued_range_count_ > 0;
+        });
+        if (stopping_ && queued_range_count_ == 0) {
+            return;
+        }
+    }
+}
+
+bool QueryExecutor::RunQueuedRange(size_t queue) {
+    std::optional<Range> range;
+    {
+        WorkQueue& own_queue = *queues_[queue];
+        const std::lock_guard guard(own_queue.mutex);
+        if (!own_queue.ranges.empty()) {
+            range = own_queue.ranges.back();
+            own_queue.ranges.pop_back();
+        }
+    }
+    for (size_t i = 1; !range && i < queues_.size(); ++i) {
+        WorkQueue& victim = *queues_[(queue + i) % queues_.size()];
+        const std::lock_guard guard(victim.mutex);
+        if (!victim.ranges.empty()) {
+            range = victim.ranges.front();
+            victim.ranges.pop_front();
+        }
+    }
+    if (!range) {
+        return false;
+    }
+    {
+        const std::lock_guard guard(sleep_mutex_);
+        --queued_range_count_;
+    }
+    RunRange(*range);
+    return true;
+}
+
+bool QueryExecutor::RunBatchRange(const Batch& batch) {
+    std::optional<Range> range;
+    for (size_t i = 0; !range && i < queues_.size(); ++i) {
+        WorkQueue& queue = *queues_[i];
+        const std::lock_guard guard(queue.mutex);
+        const auto it = std::find_if(queue.ranges.rbegin(), queue.ranges.rend(), [&batch](const Range& queued) {
+            return queued.batch == &batch;
+        });
+        if (it != queue.ranges.rend()) {
+            range = *it;
+            queue.ranges.erase(std::next(it).base());
+        }
+    }
+    if (!range) {
+        return false;
+    }
+    {
+        const std::lock_guard guard(sleep_mutex_);
+        --queued_range_count_;
+    }
+    RunRange(*range);
+    return true;
+}
+
+void QueryExecutor::RunRange(const Range& range) {
+    Batch& batch = *range.batch;
+    std::exception_ptr error;
+    try {
+        batch.body(range.begin, range.end);
+    }
+    catch (...) {
+        error = std::current_exception();
+    }
+    const std::lock_guard guard(batch.mutex);
+    if (error && !batch.error) {
+        batch.error = error;
+    }
+    if (--batch.remaining == 0) {
+        batch.done.notify_all();
+    }
+}
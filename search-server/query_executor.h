@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// Thread pool for running many independent queries.
+// A batch is split into index ranges that are spread over per-worker
+// queues; a worker takes ranges from the back of its own queue and, when it
+// runs dry, steals from the front of the others. The thread that submits a
+// batch works on the ranges of that batch only. Calls made from a worker run
+// inline, so a query never waits for the pool that runs it.
+class QueryExecutor {
+private:
+    struct Batch;
+
+public:
+    // Batch started by Submit; waits for its calls when destroyed
+    class Submission {
+    public:
+        Submission(Submission&&) = default;
+        Submission& operator=(Submission&&) = delete;
+
+        ~Submission();
+
+        // Returns when all calls are done. The first exception thrown by
+        // func is rethrown.
+        void Wait();
+
+    private:
+        friend class QueryExecutor;
+
+        Submission(QueryExecutor& executor, std::unique_ptr<Batch> batch)
+            : executor_(&executor)
+            , batch_(std::move(batch)) {
+        }
+
+        QueryExecutor* executor_;
+        std::unique_ptr<Batch> batch_;
+    };
+
+    explicit QueryExecutor(size_t worker_count);
+
+    QueryExecutor(const QueryExecutor&) = delete;
+    QueryExecutor& operator=(const QueryExecutor&) = delete;
+
+    ~QueryExecutor();
+
+    size_t GetWorkerCount() const {
+        return threads_.size();
+    }
+
+    // Calls func(index) for every index in [0, count) and returns when all
+    // calls are done. The first exception thrown by func is rethrown.
+    template <typename Func>
+    void ForEach(size_t count, Func func) {
+        Batch batch([&func](size_t begin, size_t end) {
+            for (size_t index = begin; index < end; ++index) {
+                func(index);
+            }
+        });
+        Start(batch, count);
+        Wait(batch);
+    }
+
+    // Starts func(index) for every index in [0, count) and returns without
+    // waiting; func is kept until the calls are done. Without workers, or
+    // from a worker, the calls run before Submit returns.
+    template <typename Func>
+    Submission Submit(size_t count, Func func) {
+        auto batch = std::make_unique<Batch>([func = std::move(func)](size_t begin, size_t end) {
+            for (size_t index = begin; index < end; ++index) {
+                func(index);
+            }
+        });
+        Start(*batch, count);
+        return Submission(*this, std::move(batch));
+    }
+
+    // Whether the calling thread is a worker of any executor
+    static bool IsWorkerThread();
+
+    // Shared executor with a worker for every hardware thread but the caller's
+    static QueryExecutor& GetDefault();
+
+private:
+    inline static const size_t RANGES_PER_THREAD = 4;
+
+    struct Batch {
+        explicit Batch(std::function<void(size_t, size_t)> body)
+            : body(std::move(body)) {
+        }
+
+        std::function<void(size_t, size_t)> body;
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t remaining = 0;
+        std::exception_ptr error;
+    };
+
+    struct Range {
+        Batch* batch;
+        size_t begin;
+        size_t end;
+    };
+
+    struct alignas(64) WorkQueue {
+        std::mutex mutex;
+        std::deque<Range> ranges;
+    };
+
+    // Queues the ranges of the batch, or runs it inline
+    void Start(Batch& batch, size_t count);
+
+    // Works on the ranges of the batch until all of them are done and
+    // rethrows its first exception
+    void Wait(Batch& batch);
+
+    void WaitForRanges(Batch& batch);
+
+    void RunWorker(size_t worker);
+
+    // Runs one range from the queue, or one stolen from another queue;
+    // returns false if all queues are empty
+    bool RunQueuedRange(size_t queue);
+
+    // Runs one queued range of the batch; returns false if none is left
+    bool RunBatchRange(const Batch& batch);
+
+    void RunRange(const Range& range);
+
+    // One queue per worker and a last one for submitting threads
+    std::vector<std::unique_ptr<WorkQueue>> queues_;
+    std::mutex sleep_mutex_;
+    std::condition_variable work_added_;
+    size_t queued_range_count_ = 0;
+    bool stopping_ = false;
+    std::vector<std::thread> threads_;
+};
@@ -0,0 +1,169 @@
+#include "query_metrics.h"
+
+#include <algorithm>
+#include <bit>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+const char* const PHASE_NAMES[QUERY_PHASE_COUNT] = {
+    "query", "parse", "posting_traversal", "filtering", "top_k", "result_build",
+};
+
+const char* const COUNTER_NAMES[QUERY_COUNTER_COUNT] = {
+    "postings_scanned", "documents_scored", "result_cache_hits", "result_cache_misses",
+};
+
+// Written only by its thread; the atomics let snapshots read it concurrently
+struct ThreadMetrics {
+    struct Phase {
+        std::atomic<uint64_t> count{ 0 };
+        std::atomic<uint64_t> total_nanoseconds{ 0 };
+        std::array<std::atomic<uint64_t>, PHASE_HISTOGRAM_BUCKET_COUNT> histogram{};
+    };
+
+    std::array<Phase, QUERY_PHASE_COUNT> phases;
+    std::array<std::atomic<uint64_t>, QUERY_COUNTER_COUNT> counters{};
+
+    // A plain load and store, as no other thread writes the value
+    static void Increase(std::atomic<uint64_t>& value, uint64_t delta) {
+        value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    void AddTo(MetricsSnapshot& snapshot) const {
+        for (size_t i = 0; i < QUERY_PHASE_COUNT; ++i) {
+            snapshot.phases[i].count += phases[i].count.load(std::memory_order_relaxed);
+            snapshot.phases[i].total_nanoseconds += phases[i].total_nanoseconds.load(std::memory_order_relaxed);
+            for (size_t j = 0; j < PHASE_HISTOGRAM_BUCKET_COUNT; ++j) {
+                snapshot.phases[i].histogram[j] += phases[i].histogram[j].load(std::memory_order_relaxed);
+            }
+        }
+        for (size_t i = 0; i < QUERY_COUNTER_COUNT; ++i) {
+            snapshot.counters[i] += counters[i].load(std::memory_order_relaxed);
+        }
+    }
+};
+
+class MetricsRegistry {
+public:
+    static MetricsRegistry& Get() {
+        static MetricsRegistry registry;
+        return registry;
+    }
+
+    void Register(const ThreadMetrics* metrics) {
+        std::lock_guard guard(mutex_);
+        threads_.push_back(metrics);
+    }
+
+    // Keeps the metrics of an exiting thread
+    void Unregister(const ThreadMetrics* metrics) {
+        std::lock_guard guard(mutex_);
+        metrics->AddTo(exited_threads_);
+        threads_.erase(std::find(threads_.begin(), threads_.end(), metrics));
+    }
+
+    MetricsSnapshot GetSnapshot() const {
+        std::lock_guard guard(mutex_);
+        MetricsSnapshot snapshot = exited_threads_;
+        for (const ThreadMetrics* metrics : threads_) {
+            metrics->AddTo(snapshot);
+        }
+        return snapshot;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<const ThreadMetrics*> threads_;
+    MetricsSnapshot exited_threads_;
+};
+
+class ThreadMetricsRegistration {
+public:
+    ThreadMetricsRegistration()
+        // Constructs the registry first, so it outlives the thread-local metrics
+        : registry_(MetricsRegistry::Get())
+    {
+        registry_.Register(&metrics_);
+    }
+
+    ~ThreadMetricsRegistration() {
+        registry_.Unregister(&metrics_);
+    }
+
+    ThreadMetrics& GetMetrics() {
+        return metrics_;
+    }
+
+private:
+    MetricsRegistry& registry_;
+    ThreadMetrics metrics_;
+};
+
+ThreadMetrics& GetThreadMetrics() {
+    thread_local ThreadMetricsRegistration registration;
+    return registration.GetMetrics();
+}
+
+// Upper bound of the durations in a histogram bucket, in nanoseconds
+uint64_t GetBucketBound(size_t bucket) {
+    return uint64_t{ 1 } << bucket;
+}
+
+// Upper bound of the shortest durations that make up the given share of the phase
+uint64_t GetPercentileBound(const PhaseStats& phase, double share) {
+    uint64_t covered = 0;
+    for (size_t bucket = 0; bucket < PHASE_HISTOGRAM_BUCKET_COUNT; ++bucket) {
+        covered += phase.histogram[bucket];
+        if (covered >= share * phase.count) {
+            return GetBucketBound(bucket);
+        }
+    }
+    return GetBucketBound(PHASE_HISTOGRAM_BUCKET_COUNT - 1);
+}
+
+}  // namespace
+
+namespace query_metrics_detail {
+
+void RecordPhase(QueryPhase phase, std::chrono::steady_clock::duration duration) {
+    const uint64_t nanoseconds = std::max<int64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), 0);
+    ThreadMetrics::Phase& metrics = GetThreadMetrics().phases[static_cast<size_t>(phase)];
+    ThreadMetrics::Increase(metrics.count, 1);
+    ThreadMetrics::Increase(metrics.total_nanoseconds, nanoseconds);
+    const size_t bucket = std::min<size_t>(std::bit_width(nanoseconds), PHASE_HISTOGRAM_BUCKET_COUNT - 1);
+    ThreadMetrics::Increase(metrics.histogram[bucket], 1);
+}
+
+void RecordCounter(QueryCounter counter, uint64_t value) {
+    ThreadMetrics::Increase(GetThreadMetrics().counters[static_cast<size_t>(counter)], value);
+}
+
+}  // namespace query_metrics_detail
+
+void SetMetricsEnabled(bool enabled) {
+    query_metrics_detail::enabled.store(enabled, std::memory_order_relaxed);
+}
+
+MetricsSnapshot GetMetricsSnapshot() {
+    return MetricsRegistry::Get().GetSnapshot();
+}
+
+std::ostream& operator<<(std::ostream& out, const MetricsSnapshot& snapshot) {
+    for (size_t i = 0; i < QUERY_PHASE_COUNT; ++i) {
+        const PhaseStats& phase = snapshot.phases[i];
+        out << PHASE_NAMES[i] << ": count = " << phase.count << ", total_us = " << phase.total_nanoseconds / 1000;
+        if (phase.count > 0) {
+            out << ", mean_ns = " << phase.total_nanoseconds / phase.count
+                << ", p50_ns <= " << GetPercentileBound(phase, 0.5)
+                << ", p99_ns <= " << GetPercentileBound(phase, 0.99);
+        }
+        out << "\n";
+    }
+    for (size_t i = 0; i < QUERY_COUNTER_COUNT; ++i) {
+        out << COUNTER_NAMES[i] << ": " << snapshot.counters[i] << "\n";
+    }
+    return out;
+}
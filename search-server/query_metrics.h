@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Timers and counters of the query path, kept per thread and summed by
+// GetMetricsSnapshot(). They are off until SetMetricsEnabled(true); then
+// a disabled timer costs one relaxed load. Defining
+// SEARCH_SERVER_DISABLE_METRICS compiles them out altogether.
+
+enum class QueryPhase {
+    // Whole searches run through ProcessQueries or RequestQueue
+    QUERY,
+    PARSE,
+    // Scoring the postings of the plus words
+    POSTING_TRAVERSAL,
+    // Excluding documents by minus words and evaluating document filters
+    FILTERING,
+    // Selecting and merging the best documents
+    TOP_K,
+    // Sorting the selected documents into the result
+    RESULT_BUILD,
+};
+
+enum class QueryCounter {
+    POSTINGS_SCANNED,
+    DOCUMENTS_SCORED,
+    RESULT_CACHE_HITS,
+    RESULT_CACHE_MISSES,
+};
+
+inline const size_t QUERY_PHASE_COUNT = 6;
+inline const size_t QUERY_COUNTER_COUNT = 4;
+// Bucket i holds durations below 2^i nanoseconds that are not in bucket
+// i - 1; the last bucket holds all longer ones
+inline const size_t PHASE_HISTOGRAM_BUCKET_COUNT = 40;
+
+struct PhaseStats {
+    uint64_t count = 0;
+    uint64_t total_nanoseconds = 0;
+    std::array<uint64_t, PHASE_HISTOGRAM_BUCKET_COUNT> histogram{};
+};
+
+struct MetricsSnapshot {
+    std::array<PhaseStats, QUERY_PHASE_COUNT> phases{};
+    std::array<uint64_t, QUERY_COUNTER_COUNT> counters{};
+
+    const PhaseStats& operator[](QueryPhase phase) const {
+        return phases[static_cast<size_t>(phase)];
+    }
+
+    uint64_t operator[](QueryCounter counter) const {
+        return counters[static_cast<size_t>(counter)];
+    }
+};
+
+#ifdef SEARCH_SERVER_DISABLE_METRICS
+inline constexpr bool METRICS_COMPILED = false;
+#else
+inline constexpr bool METRICS_COMPILED = true;
+#endif
+
+namespace query_metrics_detail {
+
+inline std::atomic<bool> enabled{ false };
+
+void RecordPhase(QueryPhase phase, std::chrono::steady_clock::duration duration);
+
+void RecordCounter(QueryCounter counter, uint64_t value);
+
+}  // namespace query_metrics_detail
+
+void SetMetricsEnabled(bool enabled);
+
+inline bool AreMetricsEnabled() {
+    if constexpr (METRICS_COMPILED) {
+        return query_metrics_detail::enabled.load(std::memory_order_relaxed);
+    }
+    else {
+        return false;
+    }
+}
+
+// Sum over all threads since the start of the program, including threads
+// that have exited
+MetricsSnapshot GetMetricsSnapshot();
+
+// One line per phase and per counter
+std::ostream& operator<<(std::ostream& out, const MetricsSnapshot& snapshot);
+
+inline void AddQueryCounter(QueryCounter counter, uint64_t value) {
+    if (AreMetricsEnabled()) {
+        query_metrics_detail::RecordCounter(counter, value);
+    }
+}
+
+// Records the time until its destruction
+class PhaseTimer {
+public:
+    explicit PhaseTimer(QueryPhase phase)
+        : phase_(phase)
+        , enabled_(AreMetricsEnabled())
+    {
+        if (enabled_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    ~PhaseTimer() {
+        if (enabled_) {
+            query_metrics_detail::RecordPhase(phase_, std::chrono::steady_clock::now() - start_);
+        }
+    }
+
+private:
+    QueryPhase phase_;
+    bool enabled_;
+    std::chrono::steady_clock::time_point start_;
+};
@@ -0,0 +1,61 @@
+#include "query_result_cache.h"
+
+#include <functional>
+
+QueryResultCache::QueryResultCache(size_t capacity)
+    : capacity_(capacity)
+    , shard_capacity_((capacity + SHARD_COUNT - 1) / SHARD_COUNT) {
+}
+
+std::optional<std::vector<Document>> QueryResultCache::Find(const std::string& key, uint64_t generation) {
+    if (capacity_ == 0) {
+        return std::nullopt;
+    }
+    Shard& shard = GetShard(key);
+    const std::lock_guard guard(shard.mutex);
+    const auto position = shard.positions.find(key);
+    if (position == shard.positions.end()) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+    const auto entry = position->second;
+    if (entry->generation != generation) {
+        shard.positions.erase(position);
+        shard.entries.erase(entry);
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return entry->documents;
+}
+
+void QueryResultCache::Insert(const std::string& key, uint64_t generation, const std::vector<Document>& documents) {
+    if (capacity_ == 0) {
+        return;
+    }
+    Shard& shard = GetShard(key);
+    const std::lock_guard guard(shard.mutex);
+    const auto position = shard.positions.find(key);
+    if (position != shard.positions.end()) {
+        // A concurrent query may have stored the same result already
+        position->second->generation = generation;
+        position->second->documents = documents;
+        shard.entries.splice(shard.entries.begin(), shard.entries, position->second);
+        return;
+    }
+    if (shard.entries.size() == shard_capacity_) {
+        shard.positions.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+    }
+    shard.entries.push_front({ key, generation, documents });
+    shard.positions.emplace(shard.entries.front().key, shard.entries.begin());
+}
+
+ResultCacheStats QueryResultCache::GetStats() const {
+    return { hits_.load(std::memory_order_relaxed), misses_.load(std::memory_order_relaxed) };
+}
+
+QueryResultCache::Shard& QueryResultCache::GetShard(const std::string& key) {
+    return shards_[std::hash<std::string>{}(key) % SHARD_COUNT];
+}
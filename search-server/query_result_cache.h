@@ -0,0 +1,67 @@
+#pragma once
+
+#include "document.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+const size_t DEFAULT_RESULT_CACHE_CAPACITY = 4096;
+
+struct ResultCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
+// Bounded cache of search results, safe for concurrent queries.
+// Keys are spread over shards, each with its own lock and LRU order.
+// Every entry remembers the index generation it was computed in and is
+// dropped when looked up in a later one, so index mutations only need to
+// bump the generation.
+class QueryResultCache {
+public:
+    // A capacity of zero disables the cache
+    explicit QueryResultCache(size_t capacity);
+
+    size_t GetCapacity() const {
+        return capacity_;
+    }
+
+    std::optional<std::vector<Document>> Find(const std::string& key, uint64_t generation);
+
+    void Insert(const std::string& key, uint64_t generation, const std::vector<Document>& documents);
+
+    ResultCacheStats GetStats() const;
+
+private:
+    inline static const size_t SHARD_COUNT = 16;
+
+    struct Entry {
+        std::string key;
+        uint64_t generation;
+        std::vector<Document> documents;
+    };
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        // Most recently used first
+        std::list<Entry> entries;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> positions;
+    };
+
+    Shard& GetShard(const std::string& key);
+
+    size_t capacity_;
+    size_t shard_capacity_;
+    std::array<Shard, SHARD_COUNT> shards_;
+    std::atomic<uint64_t> hits_ = 0;
+    std::atomic<uint64_t> misses_ = 0;
+};
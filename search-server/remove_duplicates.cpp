@@ -1,34 +1,185 @@
 #include "remove_duplicates.h"
+#include "term_set_fingerprint.h"
 
-#include <vector>
-#include <map>
-#include <set>
-#include <string>
-#include <iterator>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+#include <utility>
 
-void RemoveDuplicates(SearchServer& search_server) {
-    std::vector<int> duplicates_ids;
-    std::set<std::set<std::string>> words_in_docs;
+namespace {
+
+struct DocumentTermIds {
+    int document_id;
+    std::vector<TermId> term_ids;
+};
+
+template <typename ExecutionPolicy>
+std::vector<DocumentTermIds> GetAllDocumentTermIds(const ExecutionPolicy& policy, const SearchServer& search_server) {
+    std::vector<DocumentTermIds> documents;
+    documents.reserve(search_server.GetDocumentCount());
     for (const int document_id : search_server) {
-        std::set<std::string> words;
-        for (const auto [word, freq] : search_server.GetWordFrequencies(document_id))
-        {
-            words.emplace(word);
+        documents.push_back({ document_id, {} });
+    }
+    std::for_each(policy, documents.begin(), documents.end(), [&search_server](DocumentTermIds& document) {
+        document.term_ids = search_server.GetDocumentTermIds(document.document_id);
+    });
+    return documents;
+}
+
+double ComputeJaccardSimilarity(const std::vector<TermId>& lhs, const std::vector<TermId>& rhs) {
+    size_t common = 0;
+    auto lhs_it = lhs.begin();
+    auto rhs_it = rhs.begin();
+    while (lhs_it != lhs.end() && rhs_it != rhs.end()) {
+        if (*lhs_it < *rhs_it) {
+            ++lhs_it;
+        }
+        else if (*rhs_it < *lhs_it) {
+            ++rhs_it;
+        }
+        else {
+            ++common;
+            ++lhs_it;
+            ++rhs_it;
+        }
+    }
+    const size_t united = lhs.size() + rhs.size() - common;
+    return united == 0 ? 1.0 : static_cast<double>(common) / united;
+}
+
+template <typename ExecutionPolicy>
+std::vector<int> FindExactDuplicates(const ExecutionPolicy& policy, const std::vector<DocumentTermIds>& documents) {
+    std::vector<uint64_t> fingerprints(documents.size());
+    std::transform(policy, documents.begin(), documents.end(), fingerprints.begin(),
+        [](const DocumentTermIds& document) {
+            return ComputeTermSetFingerprint(document.term_ids.data(),
+                document.term_ids.data() + document.term_ids.size());
+        });
+
+    std::vector<int> duplicate_ids;
+    // Kept documents by fingerprint; equal fingerprints are confirmed by the sets
+    std::unordered_multimap<uint64_t, size_t> originals;
+    originals.reserve(documents.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const auto [begin, end] = originals.equal_range(fingerprints[i]);
+        const bool is_duplicate = std::any_of(begin, end, [&](const auto& original) {
+            return documents[original.second].term_ids == documents[i].term_ids;
+        });
+        if (is_duplicate) {
+            duplicate_ids.push_back(documents[i].document_id);
+        }
+        else {
+            originals.emplace(fingerprints[i], i);
+        }
+    }
+    return duplicate_ids;
+}
+
+// Band count and rows per band whose LSH threshold (1 / bands)^(1 / rows)
+// is the closest to the Jaccard threshold
+std::pair<size_t, size_t> ChooseBands(size_t signature_size, double jaccard_threshold) {
+    std::pair<size_t, size_t> best{ signature_size, 1 };
+    double best_error = std::numeric_limits<double>::infinity();
+    for (size_t rows = 1; rows <= signature_size; ++rows) {
+        const size_t bands = signature_size / rows;
+        const double error = std::abs(std::pow(1.0 / bands, 1.0 / rows) - jaccard_threshold);
+        if (error < best_error) {
+            best = { bands, rows };
+            best_error = error;
         }
+    }
+    return best;
+}
+
+template <typename ExecutionPolicy>
+std::vector<int> FindNearDuplicates(const ExecutionPolicy& policy, const std::vector<DocumentTermIds>& documents,
+    const DuplicateSearchOptions& options) {
+    const size_t signature_size = std::max<size_t>(options.signature_size, 1);
+    const auto [band_count, rows] = ChooseBands(signature_size, options.jaccard_threshold);
 
-        if (!words_in_docs.contains(words))
-        {
-            words_in_docs.emplace(words);
+    // Each band is hashed into a single key; the signatures themselves are not kept
+    std::vector<uint64_t> band_keys(documents.size() * band_count);
+    std::vector<size_t> indexes(documents.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+    std::for_each(policy, indexes.begin(), indexes.end(), [&](size_t index) {
+        std::vector<uint64_t> signature(signature_size, std::numeric_limits<uint64_t>::max());
+        for (const TermId term_id : documents[index].term_ids) {
+            const uint64_t term_hash = MixBits(term_id + 1);
+            for (size_t i = 0; i < signature_size; ++i) {
+                signature[i] = std::min(signature[i], MixBits(term_hash + i * 0x9E3779B97F4A7C15ull));
+            }
         }
-        else
-        {
-            std::cout << "Found duplicate document id " << document_id << "\n";
-            duplicates_ids.push_back(document_id);
+        for (size_t band = 0; band < band_count; ++band) {
+            uint64_t key = MixBits(band + 1);
+            for (size_t row = 0; row < rows; ++row) {
+                key = MixBits(key ^ signature[band * rows + row]);
+            }
+            band_keys[index * band_count + band] = key;
+        }
+    });
+
+    std::vector<int> duplicate_ids;
+    // Kept documents by band key
+    std::vector<std::unordered_map<uint64_t, std::vector<size_t>>> buckets(band_count);
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        candidates.clear();
+        for (size_t band = 0; band < band_count; ++band) {
+            const auto bucket = buckets[band].find(band_keys[i * band_count + band]);
+            if (bucket != buckets[band].end()) {
+                candidates.insert(candidates.end(), bucket->second.begin(), bucket->second.end());
+            }
         }
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+        const bool is_duplicate = std::any_of(candidates.begin(), candidates.end(), [&](size_t original) {
+            return ComputeJaccardSimilarity(documents[original].term_ids, documents[i].term_ids)
+                >= options.jaccard_threshold;
+        });
+        if (is_duplicate) {
+            duplicate_ids.push_back(documents[i].document_id);
+            continue;
+        }
+        for (size_t band = 0; band < band_count; ++band) {
+            buckets[band][band_keys[i * band_count + band]].push_back(i);
+        }
+    }
+    return duplicate_ids;
+}
+
+template <typename ExecutionPolicy>
+std::vector<int> FindDuplicatesWith(const ExecutionPolicy& policy, const SearchServer& search_server,
+    const DuplicateSearchOptions& options) {
+    if (options.jaccard_threshold >= 1.0 && search_server.GetDuplicateDetection() != DuplicateDetection::DISABLED) {
+        // The duplicate index of the server already groups the documents
+        return search_server.FindDuplicateDocuments();
+    }
+    const std::vector<DocumentTermIds> documents = GetAllDocumentTermIds(policy, search_server);
+    if (options.jaccard_threshold >= 1.0) {
+        return FindExactDuplicates(policy, documents);
     }
+    return FindNearDuplicates(policy, documents, options);
+}
 
-    for (const int& id : duplicates_ids)
+}  // namespace
+
+std::vector<int> FindDuplicates(const SearchServer& search_server, const DuplicateSearchOptions& options) {
+    return FindDuplicatesWith(std::execution::seq, search_server, options);
+}
+
+std::vector<int> FindDuplicates(const std::execution::parallel_policy& policy, const SearchServer& search_server,
+    const DuplicateSearchOptions& options) {
+    return FindDuplicatesWith(policy, search_server, options);
+}
+
+void RemoveDuplicates(SearchServer& search_server) {
+    const std::vector<int> duplicates_ids = FindDuplicates(std::execution::par, search_server);
+    for (const int id : duplicates_ids)
     {
-        search_server.RemoveDocument(id);
+        std::cout << "Found duplicate document id " << id << "\n";
     }
+    search_server.RemoveDocuments(std::execution::par, duplicates_ids);
 }
@@ -2,4 +2,30 @@
 
 #include "search_server.h"
 
+#include <cstddef>
+#include <execution>
+#include <vector>
+
+struct DuplicateSearchOptions {
+    // Documents whose word sets have at least this Jaccard similarity are
+    // duplicates; 1.0 finds documents with exactly the same words
+    double jaccard_threshold = 1.0;
+    // Number of MinHash values per document for near-duplicate search
+    size_t signature_size = 128;
+};
+
+// Ids of the documents that duplicate a document with a smaller id which
+// is not a duplicate itself, in ascending order.
+// Exact duplicates are found by word set fingerprints, or read from the
+// duplicate index of the server when its detection is enabled. Near
+// duplicates are found by MinHash signatures split into LSH bands;
+// documents sharing a band become candidates and their similarity is
+// checked exactly. Under a parallel policy, fingerprints and signatures are
+// computed concurrently.
+std::vector<int> FindDuplicates(const SearchServer& search_server,
+    const DuplicateSearchOptions& options = DuplicateSearchOptions{});
+
+std::vector<int> FindDuplicates(const std::execution::parallel_policy& policy, const SearchServer& search_server,
+    const DuplicateSearchOptions& options = DuplicateSearchOptions{});
+
 void RemoveDuplicates(SearchServer& search_server);
@@ -1,39 +1,24 @@
 #include "request_queue.h"
 
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentStatus status) {
-    std::vector<Document> result = search_server_.FindTopDocuments(raw_query, status);
-    if (result.empty())
-    {
-        count_empty_requests_ += 1;
-    }
-    requests_.push_back({ result });
-    if (requests_.size() > min_in_day_)
-    {
-        if (requests_.front().found_documents_.empty())
-        {
-            count_empty_requests_ -= 1;
-        }
-        requests_.pop_front();
-    }
-    return result;
+    return AddRequest([&](bool& from_cache) {
+        return search_server_.FindTopDocuments(raw_query, status, from_cache);
+    });
 }
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query) {
-    std::vector<Document> result = search_server_.FindTopDocuments(raw_query);
-    if (result.empty())
-    {
-        count_empty_requests_ += 1;
-    }
-    requests_.push_back({ result });
-    if (requests_.size() > min_in_day_)
-    {
-        if (requests_.front().found_documents_.empty())
-        {
-            count_empty_requests_ -= 1;
-        }
-        requests_.pop_front();
-    }
-    return result;
+    return AddRequest([&](bool& from_cache) {
+        return search_server_.FindTopDocuments(raw_query, DocumentStatus::ACTUAL, from_cache);
+    });
 }
 int RequestQueue::GetNoResultRequests() const {
-    return RequestQueue::count_empty_requests_;
-}
\ No newline at end of file
+    return static_cast<int>(statistics_.GetRecentRequests().empty_result_count);
+}
+int RequestQueue::GetCachedResultRequests() const {
+    return static_cast<int>(statistics_.GetRecentRequests().cached_result_count);
+}
+ResultCacheStats RequestQueue::GetResultCacheStats() const {
+    return search_server_.GetResultCacheStats();
+}
+const RequestStatistics& RequestQueue::GetStatistics() const {
+    return statistics_;
+}
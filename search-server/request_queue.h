@@ -2,43 +2,52 @@
 
 #include "document.h"
 #include "search_server.h"
+#include "request_statistics.h"
+#include "query_metrics.h"
 
 #include <vector>
 #include <string>
-#include <deque>
 
 class RequestQueue {
 public:
     explicit RequestQueue(const SearchServer& search_server)
-        : search_server_(search_server) {
+        : search_server_(search_server)
+        , statistics_(min_in_day_) {
     }
     template <typename DocumentPredicate>
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
-        std::vector<Document> result = search_server_.FindTopDocuments(raw_query, document_predicate);
-        if (result.empty())
-        {
-            count_empty_requests_ += 1;
-        }
-        requests_.push_back({ result });
-        if (requests_.size() > min_in_day_)
-        {
-            if (requests_.front().found_documents_.empty())
-            {
-                count_empty_requests_ -= 1;
-            }
-            requests_.pop_front();
-        }
-        return result;
+        return AddRequest([&](bool&) {
+            return search_server_.FindTopDocuments(raw_query, document_predicate);
+        });
     }
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
     std::vector<Document> AddFindRequest(const std::string& raw_query);
+    // Requests among the last 1440 with no documents found
     int GetNoResultRequests() const;
+    // Requests of the window answered from the result cache of the server;
+    // requests with a custom predicate are never cached
+    int GetCachedResultRequests() const;
+    // Cache statistics of the server over all its queries
+    ResultCacheStats GetResultCacheStats() const;
+    // Counts over the last 1440 requests, the last day and all requests;
+    // requests may be added from several threads
+    const RequestStatistics& GetStatistics() const;
 private:
-    struct QueryResult {
-        std::vector<Document> found_documents_;
-    };
-    std::deque<QueryResult> requests_;
+    // search(from_cache) sets from_cache if the server answered from its cache
+    template <typename Search>
+    std::vector<Document> AddRequest(Search search) {
+        bool from_cache = false;
+        const auto start = RequestStatistics::Clock::now();
+        std::vector<Document> result;
+        {
+            PhaseTimer timer(QueryPhase::QUERY);
+            result = search(from_cache);
+        }
+        const auto finish = RequestStatistics::Clock::now();
+        statistics_.Record(result.size(), from_cache, finish - start, finish);
+        return result;
+    }
     const static int min_in_day_ = 1440;
-    int count_empty_requests_;
     const SearchServer& search_server_;
-};
\ No newline at end of file
+    RequestStatistics statistics_;
+};
@@ -0,0 +1,125 @@
+#include "request_statistics.h"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+namespace {
+
+const uint64_t RECORD_PRESENT = uint64_t{ 1 } << 63;
+const uint64_t RECORD_FROM_CACHE = uint64_t{ 1 } << 62;
+const uint64_t RECORD_RESULT_COUNT_MASK = std::numeric_limits<uint32_t>::max();
+
+// Minute counters keep the minute in the upper bits and the count in the lower ones
+const int MINUTE_SHIFT = 40;
+const uint64_t MINUTE_COUNT_MASK = (uint64_t{ 1 } << MINUTE_SHIFT) - 1;
+
+}  // namespace
+
+RequestStatistics::RequestStatistics(size_t window_size, Clock::time_point start)
+    : window_size_(window_size)
+    , start_(start)
+    , records_(std::make_unique<std::atomic<uint64_t>[]>(window_size))
+    , minutes_(std::make_unique<MinuteBucket[]>(MINUTES_IN_DAY))
+{
+}
+
+void RequestStatistics::Record(size_t result_count, bool from_cache, Clock::duration latency, Clock::time_point now) {
+    if (window_size_ > 0) {
+        const uint64_t record = PackRecord(result_count, from_cache);
+        const uint64_t index = record_count_.fetch_add(1, std::memory_order_relaxed) % window_size_;
+        AddRecord(record, 1);
+        AddRecord(records_[index].exchange(record, std::memory_order_relaxed), -1);
+    }
+
+    const uint64_t minute = GetMinute(now);
+    MinuteBucket& bucket = minutes_[minute % MINUTES_IN_DAY];
+    AddToMinute(bucket.requests, minute, 1);
+    AddToMinute(bucket.empty_results, minute, result_count == 0 ? 1 : 0);
+    AddToMinute(bucket.cached_results, minute, from_cache ? 1 : 0);
+    AddToMinute(bucket.documents, minute, result_count);
+
+    const uint64_t microseconds = std::max<int64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(latency).count(), 0);
+    const size_t latency_bucket = std::min<size_t>(std::bit_width(microseconds), LATENCY_BUCKET_COUNT - 1);
+    latencies_[latency_bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+RequestWindowStats RequestStatistics::GetRecentRequests() const {
+    RequestWindowStats stats;
+    stats.request_count = std::min<uint64_t>(record_count_.load(std::memory_order_relaxed), window_size_);
+    stats.empty_result_count = window_empty_results_.load(std::memory_order_relaxed);
+    stats.cached_result_count = window_cached_results_.load(std::memory_order_relaxed);
+    stats.document_count = window_documents_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+RequestWindowStats RequestStatistics::GetLastDay(Clock::time_point now) const {
+    const uint64_t last_minute = GetMinute(now);
+    const uint64_t first_minute = last_minute >= MINUTES_IN_DAY ? last_minute - MINUTES_IN_DAY + 1 : 0;
+    RequestWindowStats stats;
+    for (size_t i = 0; i < MINUTES_IN_DAY; ++i) {
+        const MinuteBucket& bucket = minutes_[i];
+        stats.request_count += GetMinuteCount(bucket.requests, first_minute, last_minute);
+        stats.empty_result_count += GetMinuteCount(bucket.empty_results, first_minute, last_minute);
+        stats.cached_result_count += GetMinuteCount(bucket.cached_results, first_minute, last_minute);
+        stats.document_count += GetMinuteCount(bucket.documents, first_minute, last_minute);
+    }
+    return stats;
+}
+
+std::array<uint64_t, RequestStatistics::LATENCY_BUCKET_COUNT> RequestStatistics::GetLatencyHistogram() const {
+    std::array<uint64_t, LATENCY_BUCKET_COUNT> histogram;
+    for (size_t i = 0; i < LATENCY_BUCKET_COUNT; ++i) {
+        histogram[i] = latencies_[i].load(std::memory_order_relaxed);
+    }
+    return histogram;
+}
+
+uint64_t RequestStatistics::PackRecord(size_t result_count, bool from_cache) {
+    return RECORD_PRESENT | (from_cache ? RECORD_FROM_CACHE : 0)
+        | std::min<uint64_t>(result_count, RECORD_RESULT_COUNT_MASK);
+}
+
+void RequestStatistics::AddRecord(uint64_t record, int sign) {
+    if ((record & RECORD_PRESENT) == 0) {
+        return;
+    }
+    // Unsigned wrap-around turns the additions of a negative sign into subtractions
+    const uint64_t step = static_cast<uint64_t>(static_cast<int64_t>(sign));
+    const uint64_t result_count = record & RECORD_RESULT_COUNT_MASK;
+    if (result_count == 0) {
+        window_empty_results_.fetch_add(step, std::memory_order_relaxed);
+    }
+    if (record & RECORD_FROM_CACHE) {
+        window_cached_results_.fetch_add(step, std::memory_order_relaxed);
+    }
+    window_documents_.fetch_add(step * result_count, std::memory_order_relaxed);
+}
+
+uint64_t RequestStatistics::GetMinute(Clock::time_point time) const {
+    if (time <= start_) {
+        return 0;
+    }
+    return std::chrono::duration_cast<std::chrono::minutes>(time - start_).count();
+}
+
+void RequestStatistics::AddToMinute(std::atomic<uint64_t>& counter, uint64_t minute, uint64_t value) {
+    uint64_t current = counter.load(std::memory_order_relaxed);
+    uint64_t updated;
+    do {
+        const uint64_t current_minute = current >> MINUTE_SHIFT;
+        if (current_minute > minute) {
+            // The bucket already counts a later minute
+            return;
+        }
+        updated = current_minute == minute ? current + value : (minute << MINUTE_SHIFT) | value;
+    } while (!counter.compare_exchange_weak(current, updated, std::memory_order_relaxed));
+}
+
+uint64_t RequestStatistics::GetMinuteCount(const std::atomic<uint64_t>& counter, uint64_t first_minute,
+    uint64_t last_minute) {
+    const uint64_t value = counter.load(std::memory_order_relaxed);
+    const uint64_t minute = value >> MINUTE_SHIFT;
+    return minute >= first_minute && minute <= last_minute ? value & MINUTE_COUNT_MASK : 0;
+}
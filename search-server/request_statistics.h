@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+struct RequestWindowStats {
+    uint64_t request_count = 0;
+    uint64_t empty_result_count = 0;
+    uint64_t cached_result_count = 0;
+    // Documents returned by all the requests
+    uint64_t document_count = 0;
+};
+
+// Statistics of search requests over the last window_size requests and
+// over the last day of wall-clock time, kept in preallocated ring buffers.
+// Recording is lock-free and does not allocate, so it can be called from
+// any number of threads. Requests recorded concurrently at a window
+// boundary may be counted in either neighbouring window.
+class RequestStatistics {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    inline static const size_t MINUTES_IN_DAY = 1440;
+    // Bucket i holds latencies below 2^i microseconds that are not in bucket i - 1;
+    // the last bucket holds all longer ones
+    inline static const size_t LATENCY_BUCKET_COUNT = 32;
+
+    explicit RequestStatistics(size_t window_size, Clock::time_point start = Clock::now());
+
+    void Record(size_t result_count, bool from_cache, Clock::duration latency, Clock::time_point now = Clock::now());
+
+    // Requests among the last window_size recorded ones
+    RequestWindowStats GetRecentRequests() const;
+
+    // Requests recorded during the minute of now and the 1439 minutes before it
+    RequestWindowStats GetLastDay(Clock::time_point now = Clock::now()) const;
+
+    // Latencies of all recorded requests
+    std::array<uint64_t, LATENCY_BUCKET_COUNT> GetLatencyHistogram() const;
+
+private:
+    // Each counter is tagged with the minute it counts, so a stale bucket
+    // is reset by the first increment of a new minute without a lock
+    struct MinuteBucket {
+        std::atomic<uint64_t> requests{ 0 };
+        std::atomic<uint64_t> empty_results{ 0 };
+        std::atomic<uint64_t> cached_results{ 0 };
+        std::atomic<uint64_t> documents{ 0 };
+    };
+
+    // A request of the count window packed into one word
+    static uint64_t PackRecord(size_t result_count, bool from_cache);
+
+    void AddRecord(uint64_t record, int sign);
+
+    uint64_t GetMinute(Clock::time_point time) const;
+
+    static void AddToMinute(std::atomic<uint64_t>& counter, uint64_t minute, uint64_t value);
+
+    static uint64_t GetMinuteCount(const std::atomic<uint64_t>& counter, uint64_t first_minute, uint64_t last_minute);
+
+    const size_t window_size_;
+    const Clock::time_point start_;
+
+    std::unique_ptr<std::atomic<uint64_t>[]> records_;
+    std::atomic<uint64_t> record_count_{ 0 };
+    std::atomic<uint64_t> window_empty_results_{ 0 };
+    std::atomic<uint64_t> window_cached_results_{ 0 };
+    std::atomic<uint64_t> window_documents_{ 0 };
+
+    std::unique_ptr<MinuteBucket[]> minutes_;
+    std::array<std::atomic<uint64_t>, LATENCY_BUCKET_COUNT> latencies_{};
+};
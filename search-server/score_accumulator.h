@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Dense relevance accumulator indexed by internal document ordinal.
+// Only the slots touched by the previous query are cleared on Reset(), so
+// reusing one accumulator per thread makes scoring allocation-free.
+class ScoreAccumulator {
+public:
+    void Reset(size_t capacity) {
+        for (const int ordinal : touched_) {
+            scores_[ordinal] = 0.0;
+            states_[ordinal] = SlotState::EMPTY;
+        }
+        touched_.clear();
+        if (scores_.size() < capacity) {
+            scores_.resize(capacity, 0.0);
+            states_.resize(capacity, SlotState::EMPTY);
+        }
+    }
+
+    void Add(int ordinal, double value) {
+        if (states_[ordinal] == SlotState::EMPTY) {
+            states_[ordinal] = SlotState::SCORED;
+            touched_.push_back(ordinal);
+        }
+        scores_[ordinal] += value;
+    }
+
+    // Calls func(ordinal, score) for every scored slot
+    template <typename Func>
+    void ForEach(Func func) const {
+        for (const int ordinal : touched_) {
+            func(ordinal, scores_[ordinal]);
+        }
+    }
+
+private:
+    enum class SlotState : uint8_t {
+        EMPTY,
+        SCORED,
+    };
+
+    std::vector<double> scores_;
+    std::vector<SlotState> states_;
+    std::vector<int> touched_;
+};
@@ -1,62 +1,257 @@
 #include "search_server.h"
 #include "read_input_functions.h"
+#include "index_snapshot.h"
+#include "mapped_file.h"
+#include "term_set_fingerprint.h"
 
 #include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
 
 void SearchServer::AddDocument(int document_id, const std::string_view& document, DocumentStatus status,
     const std::vector<int>& ratings) {
-    if ((document_id < 0) || (SearchServer::documents_.count(document_id) > 0)) {
+    if ((document_id < 0) || (document_attributes_.Contains(document_id))) {
         throw std::invalid_argument("Invalid document_id");
     }
 
-    alldocs.push_back({ document.begin(), document.end() });
-    const auto words = SplitIntoWordsNoStop(alldocs.back());
+    const auto document_terms = ComputeDocumentTerms(document);
+    uint64_t fingerprint = 0;
+    if (duplicate_detection_ != DuplicateDetection::DISABLED) {
+        fingerprint = ComputeContentFingerprint(document_terms);
+        if (duplicate_detection_ == DuplicateDetection::REJECT
+            && FindDocumentWithSameWords(document_terms, fingerprint) != -1) {
+            throw std::invalid_argument("Duplicate document");
+        }
+    }
+
+    // Postings keep the ordinal of the document, so it is assigned first
+    const int ordinal = document_attributes_.Add(document_id, status, ComputeAverageRating(ratings));
+
+    // Words are interned, so the document text itself is not kept
+    auto& terms = frequencies_words_in_documents_[document_id];
+    terms.reserve(document_terms.size());
+    for (const auto& [word, term_freq, frequency] : document_terms) {
+        const TermId term_id = term_dictionary_.Intern(word);
+        word_to_document_freqs_.Add(term_id, document_id, ordinal, term_freq);
+        terms.emplace_back(term_id, frequency);
+    }
+    inverse_document_freqs_.Reserve(term_dictionary_.GetIdBound());
+    OnIndexChanged();
+
+    document_ids_.emplace(document_id);
+    if (duplicate_detection_ != DuplicateDetection::DISABLED) {
+        duplicate_index_.Add(fingerprint, document_id);
+    }
+}
+
+void SearchServer::AddDocuments(const std::vector<NewDocument>& documents) {
+    AddDocuments(std::execution::seq, documents);
+}
+
+std::vector<SearchServer::DocumentTerm> SearchServer::ComputeDocumentTerms(const std::string_view& document) const {
+    thread_local std::vector<std::string_view> words;
+    SplitIntoWordsNoStop(document, words);
+    std::sort(words.begin(), words.end());
     const double inv_word_count = 1.0 / words.size();
-    std::map<std::string_view, double> frequencies_words_;
 
-    for (const std::string_view& word : words) {
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-        if (frequencies_words_.find(word) != frequencies_words_.end())
-        {
-            frequencies_words_[word]++;
+    std::vector<DocumentTerm> document_terms;
+    for (auto begin = words.begin(); begin != words.end();) {
+        const auto end = std::find_if(begin, words.end(), [begin](const std::string_view& word) {
+            return word != *begin;
+        });
+        // Summed one occurrence at a time, like the frequencies of earlier versions
+        double term_freq = 0.0;
+        for (auto it = begin; it != end; ++it) {
+            term_freq += inv_word_count;
         }
-        else
-        {
-            frequencies_words_.emplace(word, 1);
+        document_terms.push_back({ *begin, term_freq, static_cast<double>(end - begin) / words.size() });
+        begin = end;
+    }
+    return document_terms;
+}
+
+void SearchServer::CheckNewDocumentIds(const std::vector<NewDocument>& documents) const {
+    std::vector<int> document_ids;
+    document_ids.reserve(documents.size());
+    for (const NewDocument& document : documents) {
+        if ((document.id < 0) || (document_attributes_.Contains(document.id))) {
+            throw std::invalid_argument("Invalid document_id");
         }
+        document_ids.push_back(document.id);
     }
+    std::sort(document_ids.begin(), document_ids.end());
+    if (std::adjacent_find(document_ids.begin(), document_ids.end()) != document_ids.end()) {
+        throw std::invalid_argument("Invalid document_id");
+    }
+}
 
-    for (auto& [word, frequency] : frequencies_words_)
-    {
-        frequency /= words.size();
+uint64_t SearchServer::ComputeContentFingerprint(const std::vector<DocumentTerm>& document_terms) {
+    SetFingerprint fingerprint;
+    for (const DocumentTerm& document_term : document_terms) {
+        fingerprint.Add(HashWord(document_term.word));
+    }
+    return fingerprint.Get();
+}
+
+uint64_t SearchServer::ComputeContentFingerprint(int document_id) const {
+    SetFingerprint fingerprint;
+    for (const auto& [term_id, frequency] : frequencies_words_in_documents_.at(document_id)) {
+        fingerprint.Add(HashWord(term_dictionary_.GetTerm(term_id)));
     }
+    return fingerprint.Get();
+}
 
-    frequencies_words_in_documents_.emplace(document_id, frequencies_words_);
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
-    document_ids_.emplace(document_id);
+bool SearchServer::HasSameWords(int document_id, const std::vector<DocumentTerm>& document_terms) const {
+    const auto& terms = frequencies_words_in_documents_.at(document_id);
+    if (terms.size() != document_terms.size()) {
+        return false;
+    }
+    // Both hold distinct words, so equal sizes and inclusion mean equal sets
+    return std::all_of(terms.begin(), terms.end(), [this, &document_terms](const auto& term) {
+        const std::string_view word = term_dictionary_.GetTerm(term.first);
+        const auto it = std::lower_bound(document_terms.begin(), document_terms.end(), word,
+            [](const DocumentTerm& document_term, std::string_view value) {
+                return document_term.word < value;
+            });
+        return it != document_terms.end() && it->word == word;
+    });
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query, DocumentStatus status) const {
-    return SearchServer::FindTopDocuments(
-        raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-            return document_status == status;
+bool SearchServer::HasSameWords(int document_id, int other_id) const {
+    // Terms of a document are kept in the order of their words
+    const auto& terms = frequencies_words_in_documents_.at(document_id);
+    const auto& other_terms = frequencies_words_in_documents_.at(other_id);
+    return std::equal(terms.begin(), terms.end(), other_terms.begin(), other_terms.end(),
+        [](const auto& term, const auto& other_term) {
+            return term.first == other_term.first;
         });
 }
 
+int SearchServer::FindDocumentWithSameWords(const std::vector<DocumentTerm>& document_terms,
+    uint64_t fingerprint) const {
+    return duplicate_index_.Find(fingerprint, [this, &document_terms](int document_id) {
+        return HasSameWords(document_id, document_terms);
+    });
+}
+
+void SearchServer::CheckNewDocumentDuplicates(const std::vector<std::vector<DocumentTerm>>& document_terms,
+    const std::vector<uint64_t>& fingerprints) const {
+    if (duplicate_detection_ != DuplicateDetection::REJECT) {
+        return;
+    }
+    const auto has_same_words = [](const std::vector<DocumentTerm>& lhs, const std::vector<DocumentTerm>& rhs) {
+        return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+            [](const DocumentTerm& lhs_term, const DocumentTerm& rhs_term) {
+                return lhs_term.word == rhs_term.word;
+            });
+    };
+    std::unordered_multimap<uint64_t, size_t> batch_documents;
+    for (size_t index = 0; index < document_terms.size(); ++index) {
+        const auto [begin, end] = batch_documents.equal_range(fingerprints[index]);
+        const bool repeats_batch_document = std::any_of(begin, end, [&](const auto& batch_document) {
+            return has_same_words(document_terms[batch_document.second], document_terms[index]);
+        });
+        if (repeats_batch_document || FindDocumentWithSameWords(document_terms[index], fingerprints[index]) != -1) {
+            throw std::invalid_argument("Duplicate document");
+        }
+        batch_documents.emplace(fingerprints[index], index);
+    }
+}
+
+void SearchServer::RemoveDocumentFingerprint(int document_id) {
+    if (duplicate_detection_ != DuplicateDetection::DISABLED) {
+        duplicate_index_.Remove(ComputeContentFingerprint(document_id), document_id);
+    }
+}
+
+void SearchServer::SetDuplicateDetection(DuplicateDetection detection) {
+    duplicate_index_.Clear();
+    duplicate_detection_ = detection;
+    if (detection == DuplicateDetection::DISABLED) {
+        return;
+    }
+    for (const int document_id : document_ids_) {
+        duplicate_index_.Add(ComputeContentFingerprint(document_id), document_id);
+    }
+}
+
+std::optional<int> SearchServer::FindOriginalDocument(int document_id) const {
+    if (duplicate_detection_ == DuplicateDetection::DISABLED || !document_attributes_.Contains(document_id)) {
+        return std::nullopt;
+    }
+    const std::vector<TermId> term_ids = GetDocumentTermIds(document_id);
+    const int original_id = duplicate_index_.Find(ComputeContentFingerprint(document_id),
+        [this, &term_ids](int other_id) {
+            return GetDocumentTermIds(other_id) == term_ids;
+        });
+    if (original_id == -1 || original_id >= document_id) {
+        return std::nullopt;
+    }
+    return original_id;
+}
+
+std::vector<int> SearchServer::FindDuplicateDocuments() const {
+    std::vector<int> duplicate_ids;
+    if (duplicate_detection_ == DuplicateDetection::DISABLED) {
+        return duplicate_ids;
+    }
+    std::vector<int> original_ids;
+    duplicate_index_.ForEachSharedFingerprint([this, &duplicate_ids, &original_ids](const std::vector<int>& document_ids) {
+        // Ids ascend, so the first document with some words is their original
+        original_ids.clear();
+        for (const int document_id : document_ids) {
+            const bool is_duplicate = std::any_of(original_ids.begin(), original_ids.end(),
+                [this, document_id](int original_id) {
+                    return HasSameWords(original_id, document_id);
+                });
+            if (is_duplicate) {
+                duplicate_ids.push_back(document_id);
+            }
+            else {
+                original_ids.push_back(document_id);
+            }
+        }
+    });
+    std::sort(duplicate_ids.begin(), duplicate_ids.end());
+    return duplicate_ids;
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query, DocumentStatus status) const {
+    bool from_cache = false;
+    return FindTopDocuments(raw_query, status, from_cache);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query, DocumentStatus status,
+    bool& from_cache) const {
+    const ScratchLease<Query> query;
+    ParseQuery(raw_query, *query);
+    return FindTopDocumentsCached(std::execution::seq, *query, status, from_cache);
+}
+
 std::vector<Document> SearchServer::FindTopDocuments(const std::execution::sequenced_policy& policy,
     const std::string_view& raw_query, DocumentStatus status) const {
-    return SearchServer::FindTopDocuments(
-        policy, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-            return document_status == status;
-        });
+    return SearchServer::FindTopDocuments(raw_query, status);
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy& policy,
     const std::string_view& raw_query, DocumentStatus status) const {
-    return SearchServer::FindTopDocuments(
-        policy, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-            return document_status == status;
-        });
+    const auto query = ParseQuery(raw_query);
+    bool from_cache = false;
+    return FindTopDocumentsCached(policy, query, status, from_cache);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query, const DocumentFilter& filter,
+    const SearchOptions& options) const {
+    const ScratchLease<Query> query;
+    ParseQuery(raw_query, *query);
+    return FindFilteredDocuments(std::execution::seq, *query, filter, options);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy& policy,
+    const std::string_view& raw_query, const DocumentFilter& filter, const SearchOptions& options) const {
+    const auto query = ParseQuery(raw_query);
+    return FindFilteredDocuments(policy, query, filter, options);
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query) const {
@@ -73,8 +268,16 @@ std::vector<Document> SearchServer::FindTopDocuments(const std::execution::paral
     return SearchServer::FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
 }
 
+void SearchServer::SetResultCacheCapacity(size_t capacity) {
+    result_cache_ = std::make_unique<QueryResultCache>(capacity);
+}
+
+ResultCacheStats SearchServer::GetResultCacheStats() const {
+    return result_cache_->GetStats();
+}
+
 size_t SearchServer::GetDocumentCount() const {
-    return SearchServer::documents_.size();
+    return document_attributes_.size();
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::string_view& raw_query,
@@ -90,29 +293,23 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
     if (std::any_of(
         query.minus_words.begin(), query.minus_words.end(),
         [&](const std::string_view& word) {
-            return frequencies_words_in_documents_.at(document_id).count(word);
+            return ContainsWord(word, document_id);
         })) {
-        return std::make_tuple(matched_words, documents_.at(document_id).status);
+        return std::make_tuple(matched_words, document_attributes_.GetStatus(document_attributes_.FindOrdinal(document_id)));
     }
 
     for (const std::string_view& word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
+        if (ContainsWord(word, document_id)) {
             matched_words.push_back(word);
         }
     }
     for (const std::string_view& word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
+        if (ContainsWord(word, document_id)) {
             matched_words.clear();
             break;
         }
     }
-    return { matched_words, documents_.at(document_id).status };
+    return { matched_words, document_attributes_.GetStatus(document_attributes_.FindOrdinal(document_id)) };
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(
@@ -135,9 +332,9 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
         policy,
         query.minus_words.begin(), query.minus_words.end(),
         [&](std::string_view word) {
-            return frequencies_words_in_documents_.at(document_id).count(word);
+            return ContainsWord(word, document_id);
         })) {
-        return std::make_tuple(matched_words, documents_.at(document_id).status);
+        return std::make_tuple(matched_words, document_attributes_.GetStatus(document_attributes_.FindOrdinal(document_id)));
     }
 
     matched_words.resize(query.plus_words.size());
@@ -147,7 +344,7 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
         query.plus_words.begin(), query.plus_words.end(),
         matched_words.begin(),
         [&](std::string_view word) {
-            return word_to_document_freqs_.at(word).count(document_id);
+            return ContainsWord(word, document_id);
         }
     );
 
@@ -155,7 +352,216 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
     std::sort(policy, matched_words.begin(), matched_words.end());
     matched_words.erase(std::unique(policy, matched_words.begin(), matched_words.end()), matched_words.end());
 
-    return std::make_tuple(matched_words, documents_.at(document_id).status);
+    return std::make_tuple(matched_words, document_attributes_.GetStatus(document_attributes_.FindOrdinal(document_id)));
+}
+
+void SearchServer::SetIndexRepresentation(IndexRepresentation representation) {
+    word_to_document_freqs_.SetRepresentation(representation);
+}
+
+size_t SearchServer::GetIndexMemoryUsage() const {
+    return word_to_document_freqs_.GetMemoryUsage();
+}
+
+void SearchServer::SetBackgroundIndexMerging(bool enabled) {
+    word_to_document_freqs_.SetBackgroundMerging(enabled);
+}
+
+void SearchServer::FinishIndexMerges() {
+    word_to_document_freqs_.FinishMerges();
+}
+
+void SearchServer::SaveSnapshot(const std::string& path) const {
+    // The snapshot replaces the file atomically, so servers that have
+    // the previous one mapped keep reading it
+    const std::string temporary_path = path + ".tmp";
+    std::ofstream output(temporary_path, std::ios::binary);
+    if (!output) {
+        throw std::runtime_error("Cannot open snapshot file " + temporary_path);
+    }
+    SnapshotWriter writer(output);
+    writer.WriteHeader();
+
+    writer.Write<uint64_t>(stop_words_.size());
+    for (const std::string& stop_word : stop_words_) {
+        writer.WriteString(stop_word);
+    }
+
+    // Terms are numbered densely in the snapshot, in the order of their ids
+    std::vector<uint64_t> term_indexes(term_dictionary_.GetIdBound());
+    writer.Write<uint64_t>(term_dictionary_.size());
+    std::vector<int> document_ids;
+    std::vector<double> term_freqs;
+    uint64_t term_count = 0;
+    for (TermId term_id = 0; term_id < term_dictionary_.GetIdBound(); ++term_id) {
+        const PostingList* postings = word_to_document_freqs_.Find(term_id);
+        if (postings == nullptr) {
+            continue;
+        }
+        term_indexes[term_id] = term_count++;
+        document_ids.clear();
+        term_freqs.clear();
+        for (const auto [document_id, term_freq] : *postings) {
+            document_ids.push_back(document_id);
+            term_freqs.push_back(term_freq);
+        }
+        writer.WriteString(term_dictionary_.GetTerm(term_id));
+        writer.Write<uint64_t>(document_ids.size());
+        writer.Write<double>(*std::max_element(term_freqs.begin(), term_freqs.end()));
+        writer.WriteArray(document_ids.data(), document_ids.size());
+        writer.WriteArray(term_freqs.data(), term_freqs.size());
+    }
+
+    writer.Write<uint64_t>(document_ids_.size());
+    for (const int document_id : document_ids_) {
+        const auto& terms = frequencies_words_in_documents_.at(document_id);
+        const int ordinal = document_attributes_.FindOrdinal(document_id);
+        writer.Write<int32_t>(document_id);
+        writer.Write<int32_t>(document_attributes_.GetRating(ordinal));
+        writer.Write<int32_t>(static_cast<int32_t>(document_attributes_.GetStatus(ordinal)));
+        writer.Write<uint64_t>(terms.size());
+        for (const auto& [term_id, frequency] : terms) {
+            writer.Write<uint64_t>(term_indexes[term_id]);
+            writer.Write<double>(frequency);
+        }
+    }
+
+    output.close();
+    if (!output) {
+        throw std::runtime_error("Cannot write snapshot file " + temporary_path);
+    }
+    std::filesystem::rename(temporary_path, path);
+}
+
+SearchServer SearchServer::LoadSnapshot(const std::string& path) {
+    auto snapshot = std::make_shared<const MappedFile>(path);
+    SnapshotReader reader(snapshot->data(), snapshot->size());
+    reader.ReadHeader();
+
+    std::vector<std::string_view> stop_words(reader.ReadCount(sizeof(uint64_t)));
+    for (std::string_view& stop_word : stop_words) {
+        stop_word = reader.ReadString();
+    }
+    SearchServer server(stop_words);
+
+    // The snapshot is validated as it is read, so a loaded server is always
+    // consistent: postings are sorted and unique, the terms and the
+    // documents list each other, and statuses are valid
+    struct SnapshotTerm {
+        TermId term_id;
+        const int* document_ids;
+        const double* term_freqs;
+        uint64_t size;
+        double max_term_freq;
+        uint64_t document_count;
+        int last_document_id;
+    };
+    std::vector<SnapshotTerm> terms(reader.ReadCount(3 * sizeof(uint64_t)));
+    for (SnapshotTerm& snapshot_term : terms) {
+        const std::string_view term = reader.ReadString();
+        const uint64_t size = reader.Read<uint64_t>();
+        const double max_term_freq = reader.Read<double>();
+        const int* document_ids = reader.ReadArray<int>(size);
+        const double* term_freqs = reader.ReadArray<double>(size);
+        if (size == 0 || size > std::numeric_limits<uint32_t>::max() || server.term_dictionary_.Find(term)) {
+            throw std::runtime_error("Snapshot is corrupted");
+        }
+        for (uint64_t i = 0; i < size; ++i) {
+            if (document_ids[i] < 0 || (i > 0 && document_ids[i] <= document_ids[i - 1])
+                || !(term_freqs[i] >= 0.0 && term_freqs[i] <= max_term_freq)) {
+                throw std::runtime_error("Snapshot is corrupted");
+            }
+        }
+        // Every document containing the term holds a reference to it
+        const TermId term_id = server.term_dictionary_.Intern(term, static_cast<uint32_t>(size));
+        snapshot_term = { term_id, document_ids, term_freqs, size, max_term_freq, 0, -1 };
+    }
+
+    const uint64_t document_count = reader.ReadCount(3 * sizeof(int32_t) + sizeof(uint64_t));
+    for (uint64_t i = 0; i < document_count; ++i) {
+        const int document_id = reader.Read<int32_t>();
+        const int rating = reader.Read<int32_t>();
+        const int32_t status = reader.Read<int32_t>();
+        if (document_id < 0 || server.document_attributes_.Contains(document_id)
+            || status < static_cast<int32_t>(DocumentStatus::ACTUAL)
+            || status > static_cast<int32_t>(DocumentStatus::REMOVED)) {
+            throw std::runtime_error("Snapshot is corrupted");
+        }
+        auto& document_terms = server.frequencies_words_in_documents_[document_id];
+        document_terms.resize(reader.ReadCount(sizeof(uint64_t) + sizeof(double)));
+        for (auto& [term_id, frequency] : document_terms) {
+            const uint64_t term_index = reader.Read<uint64_t>();
+            if (term_index >= terms.size()) {
+                throw std::runtime_error("Snapshot is corrupted");
+            }
+            SnapshotTerm& snapshot_term = terms[term_index];
+            if (snapshot_term.last_document_id == document_id
+                || !std::binary_search(snapshot_term.document_ids, snapshot_term.document_ids + snapshot_term.size,
+                    document_id)) {
+                throw std::runtime_error("Snapshot is corrupted");
+            }
+            snapshot_term.last_document_id = document_id;
+            ++snapshot_term.document_count;
+            term_id = snapshot_term.term_id;
+            frequency = reader.Read<double>();
+        }
+        // Terms of a document are kept in the order of their words
+        const auto unordered_term = std::adjacent_find(document_terms.begin(), document_terms.end(),
+            [&server](const auto& term, const auto& next_term) {
+                return server.term_dictionary_.GetTerm(term.first) >= server.term_dictionary_.GetTerm(next_term.first);
+            });
+        if (unordered_term != document_terms.end()) {
+            throw std::runtime_error("Snapshot is corrupted");
+        }
+        server.document_attributes_.Add(document_id, static_cast<DocumentStatus>(status), rating);
+        server.document_ids_.emplace(document_id);
+    }
+    // Documents list a term at most once and only if it has their posting, so
+    // equal counts mean that every posting belongs to a loaded document
+    for (const SnapshotTerm& snapshot_term : terms) {
+        if (snapshot_term.document_count != snapshot_term.size) {
+            throw std::runtime_error("Snapshot is corrupted");
+        }
+    }
+
+    // Ordinals are not stored in the snapshot, as documents get them on loading
+    for (const SnapshotTerm& snapshot_term : terms) {
+        std::vector<int> ordinals(snapshot_term.size);
+        for (uint64_t i = 0; i < snapshot_term.size; ++i) {
+            ordinals[i] = server.document_attributes_.FindOrdinal(snapshot_term.document_ids[i]);
+        }
+        // The sealed postings keep the mapping alive
+        server.word_to_document_freqs_.AttachSealed(snapshot_term.term_id, snapshot_term.document_ids,
+            std::move(ordinals), snapshot_term.term_freqs, snapshot_term.size, snapshot_term.max_term_freq, snapshot);
+    }
+
+    server.inverse_document_freqs_.Reserve(server.term_dictionary_.GetIdBound());
+    server.OnIndexChanged();
+    return server;
+}
+
+std::map<std::string_view, double> SearchServer::GetWordFrequencies(int document_id) const {
+    std::map<std::string_view, double> word_frequencies;
+    const auto it = frequencies_words_in_documents_.find(document_id);
+    if (it != frequencies_words_in_documents_.end()) {
+        for (const auto& [term_id, frequency] : it->second) {
+            word_frequencies.emplace(term_dictionary_.GetTerm(term_id), frequency);
+        }
+    }
+    return word_frequencies;
+}
+
+std::vector<TermId> SearchServer::GetDocumentTermIds(int document_id) const {
+    std::vector<TermId> term_ids;
+    const auto it = frequencies_words_in_documents_.find(document_id);
+    if (it != frequencies_words_in_documents_.end()) {
+        term_ids.reserve(it->second.size());
+        for (const auto& [term_id, frequency] : it->second) {
+            term_ids.push_back(term_id);
+        }
+        std::sort(term_ids.begin(), term_ids.end());
+    }
+    return term_ids;
 }
 
 std::set<int>::iterator SearchServer::begin() {
@@ -166,26 +572,32 @@ std::set<int>::iterator SearchServer::end() {
     return SearchServer::document_ids_.end();
 }
 
+std::set<int>::const_iterator SearchServer::begin() const {
+    return document_ids_.begin();
+}
+
+std::set<int>::const_iterator SearchServer::end() const {
+    return document_ids_.end();
+}
+
 
 bool SearchServer::IsStopWord(const std::string_view& word) const {
-    const std::string tmp{ word.begin(), word.end() };
-    return SearchServer::stop_words_.count(tmp) > 0;
+    return stop_word_set_.Contains(word);
 }
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view& text) const {
-    std::vector<std::string_view> words;
-    for (const std::string_view& word : SplitIntoWords(text)) {
-        if (!SearchServer::IsValidWord(word)) {
+void SearchServer::SplitIntoWordsNoStop(const std::string_view& text, std::vector<std::string_view>& words) const {
+    words.clear();
+    ForEachWord(text, [this, &words](std::string_view word, bool has_control_chars) {
+        if (has_control_chars) {
             throw std::invalid_argument("Word is invalid");
         }
         if (!SearchServer::IsStopWord(word)) {
             words.push_back(word);
         }
-    }
-    return words;
+    });
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view& text) const {
+SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view& text, bool has_control_chars) const {
     if (text.empty()) {
         throw std::invalid_argument("Query word is empty");
     }
@@ -195,7 +607,7 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view& tex
         is_minus = true;
         word = word.substr(1);
     }
-    if (word.empty() || word[0] == '-' || !SearchServer::IsValidWord(word)) {
+    if (word.empty() || word[0] == '-' || has_control_chars) {
         throw std::invalid_argument("Query word is invalid");
     }
 
@@ -204,17 +616,16 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view& tex
 
 SearchServer::Query SearchServer::ParseQuery(const std::string_view& text) const {
     Query result;
-    for (const auto& word : SplitIntoWords(text)) {
-        const auto query_word = SearchServer::ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                result.minus_words.push_back(query_word.data);
-            }
-            else {
-                result.plus_words.push_back(query_word.data);
-            }
-        }
-    }
+    ParseQuery(text, result);
+    return result;
+}
+
+void SearchServer::ParseQuery(const std::string_view& text, Query& result) const {
+    PhaseTimer timer(QueryPhase::PARSE);
+    result.plus_words.clear();
+    result.minus_words.clear();
+    result.plus_word_inverse_document_freqs.clear();
+    AddQueryWords(text, result);
     std::sort(result.plus_words.begin(), result.plus_words.end());
     auto last = std::unique(result.plus_words.begin(), result.plus_words.end());
     result.plus_words.erase(last, result.plus_words.end());
@@ -222,43 +633,90 @@ SearchServer::Query SearchServer::ParseQuery(const std::string_view& text) const
     std::sort(result.minus_words.begin(), result.minus_words.end());
     last = std::unique(result.minus_words.begin(), result.minus_words.end());
     result.minus_words.erase(last, result.minus_words.end());
-
-    return result;
 }
 
 SearchServer::Query SearchServer::ParseQuery(const std::execution::parallel_policy&, const std::string_view& text) const {
+    PhaseTimer timer(QueryPhase::PARSE);
     Query result;
-    for (const auto& word : SplitIntoWords(text)) {
-        const auto query_word = SearchServer::ParseQueryWord(word);
+    AddQueryWords(text, result);
+    return result;
+}
+
+void SearchServer::AddQueryWords(const std::string_view& text, Query& query) const {
+    ForEachWord(text, [this, &query](std::string_view word, bool has_control_chars) {
+        const auto query_word = SearchServer::ParseQueryWord(word, has_control_chars);
         if (!query_word.is_stop) {
             if (query_word.is_minus) {
-                result.minus_words.push_back(query_word.data);
+                query.minus_words.push_back(query_word.data);
             }
             else {
-                result.plus_words.push_back(query_word.data);
+                query.plus_words.push_back(query_word.data);
             }
         }
+    });
+}
+
+std::string SearchServer::MakeResultCacheKey(const Query& query, DocumentStatus status) {
+    // Plus words never start with '-', so the key is unambiguous
+    std::string key = std::to_string(static_cast<int>(status));
+    for (const std::string_view& word : query.plus_words) {
+        key += ' ';
+        key += word;
     }
-    return result;
+    for (const std::string_view& word : query.minus_words) {
+        key += " -";
+        key += word;
+    }
+    return key;
+}
+
+const PostingList* SearchServer::FindPostings(std::string_view word) const {
+    const auto term_id = term_dictionary_.Find(word);
+    return term_id ? word_to_document_freqs_.Find(*term_id) : nullptr;
+}
+
+bool SearchServer::ContainsWord(std::string_view word, int document_id) const {
+    const auto term_id = term_dictionary_.Find(word);
+    return term_id && word_to_document_freqs_.Contains(*term_id, document_id);
+}
+
+void SearchServer::FindExcludedDocuments(const Query& query, DocumentIdSet& excluded_documents) const {
+    PhaseTimer timer(QueryPhase::FILTERING);
+    std::vector<const PostingList*> postings;
+    for (const std::string_view& word : query.minus_words) {
+        if (const PostingList* word_postings = FindPostings(word)) {
+            postings.push_back(word_postings);
+        }
+    }
+    excluded_documents.AssignUnion(postings);
+}
+
+double SearchServer::ComputeWordInverseDocumentFreq(TermId term_id) const {
+    return inverse_document_freqs_.Get(term_id, [this, term_id]() {
+        return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.Find(term_id)->size());
+    });
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const std::string_view& word) const {
-    return log(GetDocumentCount() * 1.0 / SearchServer::word_to_document_freqs_.at(word).size());
+void SearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+    RemoveDocuments(std::execution::seq, document_ids);
 }
 
 void SearchServer::RemoveDocument(int document_id) {
-    if (documents_.count(document_id) == 0)
+    if (!document_attributes_.Contains(document_id))
     {
         return;
     }
 
-    document_ids_.erase(find(document_ids_.begin(), document_ids_.end(), document_id));
-    documents_.erase(documents_.find(document_id));
-    for (auto [word, freq] : frequencies_words_in_documents_[document_id])
+    RemoveDocumentFingerprint(document_id);
+    document_ids_.erase(document_id);
+    document_attributes_.Remove(document_id);
+    for (auto [term_id, freq] : frequencies_words_in_documents_[document_id])
     {
-        word_to_document_freqs_[word].erase(document_id);
+        word_to_document_freqs_.Remove(term_id, document_id);
+        term_dictionary_.Release(term_id);
     }
     frequencies_words_in_documents_.erase(document_id);
+    OnIndexChanged();
 }
 
 void AddDocument(SearchServer& search_server, int document_id, const std::string_view& document, DocumentStatus status,
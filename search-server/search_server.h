@@ -3,7 +3,18 @@
 #include "document.h"
 #include "read_input_functions.h"
 #include "string_processing.h"
-#include "concurrent_map.h"
+#include "inverted_index.h"
+#include "top_documents.h"
+#include "score_accumulator.h"
+#include "idf_cache.h"
+#include "document_id_set.h"
+#include "query_executor.h"
+#include "query_result_cache.h"
+#include "stop_word_set.h"
+#include "document_attributes.h"
+#include "duplicate_index.h"
+#include "query_metrics.h"
+#include "thread_scratch.h"
 
 #include <string>
 #include <vector>
@@ -14,14 +25,31 @@
 #include <ostream>
 #include <set>
 #include <execution>
-#include <deque>
 #include <future>
+#include <numeric>
+#include <thread>
+#include <limits>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <type_traits>
+
+// Accepts documents with the given status. Searches by status use it
+// instead of a lambda, so scoring tests the status column directly.
+struct DocumentStatusPredicate {
+    bool operator()(int, DocumentStatus document_status, int) const {
+        return document_status == status;
+    }
+
+    DocumentStatus status;
+};
 
 class SearchServer {
 public:
     template <typename StringContainer>
     explicit SearchServer(const StringContainer& stop_words)
         : stop_words_(MakeUniqueNonEmptyStrings(stop_words))
+        , stop_word_set_(stop_words_)
     {
         if (!all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
             throw std::invalid_argument("Some of stop words are invalid");
@@ -47,6 +75,14 @@ public:
     void AddDocument(int document_id, const std::string_view& document, DocumentStatus status,
         const std::vector<int>& ratings);
 
+    // Adds a batch of documents, or none of them if any is invalid.
+    // Documents are tokenized concurrently under a parallel policy, and the
+    // postings of the batch are merged into the index one term at a time.
+    void AddDocuments(const std::vector<NewDocument>& documents);
+
+    template <typename ExecutionPolicy>
+    void AddDocuments(const ExecutionPolicy& policy, const std::vector<NewDocument>& documents);
+
     template <typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(const std::string_view& raw_query,
         DocumentPredicate document_predicate) const;
@@ -60,8 +96,34 @@ public:
         const std::string_view& raw_query, DocumentPredicate document_predicate) const;
 
 
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::string_view& raw_query,
+        DocumentPredicate document_predicate, const SearchOptions& options) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy& policy,
+        const std::string_view& raw_query, DocumentPredicate document_predicate, const SearchOptions& options) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy& policy,
+        const std::string_view& raw_query, DocumentPredicate document_predicate, const SearchOptions& options) const;
+
+
     std::vector<Document> FindTopDocuments(const std::string_view& raw_query, DocumentStatus status) const;
 
+    // Also tells whether this search was answered from the result cache
+    std::vector<Document> FindTopDocuments(const std::string_view& raw_query, DocumentStatus status,
+        bool& from_cache) const;
+
+    // The filter is evaluated over the attribute columns once per query, or
+    // per posting when the query has few postings for the number of documents
+    std::vector<Document> FindTopDocuments(const std::string_view& raw_query, const DocumentFilter& filter,
+        const SearchOptions& options = SearchOptions{}) const;
+
+    std::vector<Document> FindTopDocuments(const std::execution::parallel_policy& policy,
+        const std::string_view& raw_query, const DocumentFilter& filter,
+        const SearchOptions& options = SearchOptions{}) const;
+
     std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy& policy, 
         const std::string_view& raw_query, DocumentStatus status) const;
 
@@ -79,6 +141,53 @@ public:
 
     size_t GetDocumentCount() const;
 
+    // Compressed posting lists take less memory at the cost of block decoding
+    // during retrieval; search results do not depend on the representation
+    void SetIndexRepresentation(IndexRepresentation representation);
+
+    size_t GetIndexMemoryUsage() const;
+
+    // Posting lists are merged on a background thread by default. Finished
+    // merges are installed by later changes of the index or by FinishIndexMerges().
+    void SetBackgroundIndexMerging(bool enabled);
+
+    void FinishIndexMerges();
+
+    // Results of searches by document status are cached until the index
+    // changes; a capacity of zero disables the cache
+    void SetResultCacheCapacity(size_t capacity);
+
+    ResultCacheStats GetResultCacheStats() const;
+
+    // Documents are fingerprinted by their word sets as they are added, so a
+    // duplicate is found in constant time. Enabling the detection indexes the
+    // documents already added, including duplicates among them.
+    void SetDuplicateDetection(DuplicateDetection detection);
+
+    DuplicateDetection GetDuplicateDetection() const {
+        return duplicate_detection_;
+    }
+
+    // Smallest id of another document with the same words, if it is smaller
+    // than document_id. Always empty while the detection is disabled.
+    std::optional<int> FindOriginalDocument(int document_id) const;
+
+    // Ids of the documents that have an original, in ascending order. Only
+    // documents sharing a fingerprint are compared, so nothing is hashed.
+    std::vector<int> FindDuplicateDocuments() const;
+
+    // Incremented by every change of the indexed documents
+    uint64_t GetIndexGeneration() const {
+        return index_generation_;
+    }
+
+    // Writes stop words, terms, postings and documents to a versioned binary snapshot
+    void SaveSnapshot(const std::string& path) const;
+
+    // Restores a server saved by SaveSnapshot(). The file is memory-mapped and
+    // posting lists read it in place until they are merged.
+    static SearchServer LoadSnapshot(const std::string& path);
+
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view& raw_query,
         int document_id) const;
 
@@ -92,64 +201,80 @@ public:
 
     std::set<int>::iterator end();
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const {
-        auto result = frequencies_words_in_documents_.find(document_id);
-        if (result != frequencies_words_in_documents_.end())
-        {
-            return frequencies_words_in_documents_.at(document_id);
-        }
-        else
-        {
-            return empty_map;
-        }
-    }
+    std::set<int>::const_iterator begin() const;
+
+    std::set<int>::const_iterator end() const;
+
+    // The words view the term dictionary and stay valid until the document is removed
+    std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
+
+    // Ids of the distinct words of the document in ascending order. Equal
+    // words share an id, which stays fixed while a document contains the word.
+    std::vector<TermId> GetDocumentTermIds(int document_id) const;
 
     void RemoveDocument(int document_id);
 
+    // Removes a batch of documents; ids of absent documents are skipped.
+    // The postings of the whole batch are removed term by term, and the
+    // terms are processed concurrently under a parallel policy.
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    template <typename ExecutionPolicy>
+    void RemoveDocuments(const ExecutionPolicy& policy, const std::vector<int>& document_ids);
+
     void RemoveDocument(const std::execution::sequenced_policy& policy, int document_id) {
         RemoveDocument(document_id);
     }
 
     void RemoveDocument(const std::execution::parallel_policy& policy, int document_id) {
-        if (documents_.count(document_id) == 0)
+        if (!document_attributes_.Contains(document_id))
         {
             return;
         }
 
-        auto& words_it = frequencies_words_in_documents_.at(document_id);
-        std::vector<const std::string_view*> words(words_it.size());
+        const auto& term_freqs = frequencies_words_in_documents_.at(document_id);
+        std::vector<TermId> term_ids(term_freqs.size());
 
         std::transform(
             policy,
-            words_it.begin(), words_it.end(),
-            words.begin(),
-            [](const auto& str) {
-                return &str.first;
+            term_freqs.begin(), term_freqs.end(),
+            term_ids.begin(),
+            [](const auto& term_freq) {
+                return term_freq.first;
             }
         );
 
-        std::for_each(
-            policy,
-            words.begin(), words.end(),
-            [this, document_id](const auto& str) {
-                word_to_document_freqs_.at(*str).erase(document_id);
-            }
-        );
-        documents_.erase(document_id);
+        word_to_document_freqs_.Remove(policy, term_ids, document_id);
+        RemoveDocumentFingerprint(document_id);
+        for (const TermId term_id : term_ids) {
+            term_dictionary_.Release(term_id);
+        }
+        OnIndexChanged();
+        document_attributes_.Remove(document_id);
         document_ids_.erase(document_id);
         frequencies_words_in_documents_.erase(document_id);
     }
 
 private:
-    struct DocumentData {
-        int rating;
-        DocumentStatus status;
-    };
+    // Scores queries on its shards with corpus-wide statistics
+    friend class ShardedSearchServer;
+
+    // A filter is evaluated over all ordinals at once only if the query has
+    // at least one posting per this many ordinals
+    inline static const size_t ORDINALS_PER_POSTING_FOR_FILTER_SCAN = 8;
 
     const std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, DocumentData> documents_;
+    // Same words, looked up on every token
+    const StopWordSet stop_word_set_;
+    TermDictionary term_dictionary_;
+    InvertedIndex word_to_document_freqs_;
+    InverseDocumentFreqCache inverse_document_freqs_;
+    uint64_t index_generation_ = 0;
+    std::unique_ptr<QueryResultCache> result_cache_ = std::make_unique<QueryResultCache>(DEFAULT_RESULT_CACHE_CAPACITY);
+    DocumentAttributes document_attributes_;
     std::set<int> document_ids_;
+    DuplicateDetection duplicate_detection_ = DuplicateDetection::DISABLED;
+    DuplicateIndex duplicate_index_;
 
     struct QueryWord {
         std::string_view data;
@@ -157,15 +282,22 @@ private:
         bool is_stop;
     };
 
+    // Sequential searches parse into a ScratchLease<Query>, reusing its buffers
     struct Query {
         std::vector<std::string_view> plus_words;
         std::vector<std::string_view> minus_words;
+        // Inverse document frequencies of the plus words computed elsewhere,
+        // such as over all shards; when empty, those of this server are used
+        std::vector<double> plus_word_inverse_document_freqs;
     };
 
-    std::map<int, std::map<std::string_view, double>> frequencies_words_in_documents_;
-    inline const static std::map<std::string_view, double> empty_map;
+    std::map<int, std::vector<std::pair<TermId, double>>> frequencies_words_in_documents_;
 
-    std::deque<std::string> alldocs;
+    struct DocumentTerm {
+        std::string_view word;
+        double term_freq;
+        double frequency;
+    };
 
     bool IsStopWord(const std::string_view& word) const;
 
@@ -176,7 +308,33 @@ private:
             });
     }
 
-    std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view& text) const;
+    // Replaces the contents of words with the words of text that are not stop words
+    void SplitIntoWordsNoStop(const std::string_view& text, std::vector<std::string_view>& words) const;
+
+    // Distinct words of the document in lexicographic order
+    std::vector<DocumentTerm> ComputeDocumentTerms(const std::string_view& document) const;
+
+    // Throws if an id is negative, already added or repeated in the batch
+    void CheckNewDocumentIds(const std::vector<NewDocument>& documents) const;
+
+    static uint64_t ComputeContentFingerprint(const std::vector<DocumentTerm>& document_terms);
+
+    uint64_t ComputeContentFingerprint(int document_id) const;
+
+    bool HasSameWords(int document_id, const std::vector<DocumentTerm>& document_terms) const;
+
+    bool HasSameWords(int document_id, int other_id) const;
+
+    // Returns -1 if no indexed document has these words
+    int FindDocumentWithSameWords(const std::vector<DocumentTerm>& document_terms, uint64_t fingerprint) const;
+
+    // Throws when duplicates are rejected and a new document repeats an
+    // indexed one or an earlier document of the batch
+    void CheckNewDocumentDuplicates(const std::vector<std::vector<DocumentTerm>>& document_terms,
+        const std::vector<uint64_t>& fingerprints) const;
+
+    // Must be called while the terms of the document are still interned
+    void RemoveDocumentFingerprint(int document_id);
 
     static int ComputeAverageRating(const std::vector<int>& ratings) {
         if (ratings.empty()) {
@@ -189,50 +347,193 @@ private:
         return rating_sum / static_cast<int>(ratings.size());
     }
 
-    QueryWord ParseQueryWord(const std::string_view& text) const;
+    QueryWord ParseQueryWord(const std::string_view& text, bool has_control_chars) const;
+
+    // Appends the words of text to the query without sorting them
+    void AddQueryWords(const std::string_view& text, Query& query) const;
 
     Query ParseQuery(const std::string_view& text) const;
 
+    // Replaces the contents of result, reusing its storage
+    void ParseQuery(const std::string_view& text, Query& result) const;
+
     Query ParseQuery(const std::execution::parallel_policy&, const std::string_view& text) const;
 
-    double ComputeWordInverseDocumentFreq(const std::string_view& word) const;
+    // Invalidates everything computed from the previous documents
+    void OnIndexChanged() {
+        inverse_document_freqs_.Invalidate();
+        ++index_generation_;
+    }
+
+    // Normalized query words and the status, so equivalent queries share a key
+    static std::string MakeResultCacheKey(const Query& query, DocumentStatus status);
+
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocumentsCached(const ExecutionPolicy& policy, const Query& query,
+        DocumentStatus status, bool& from_cache) const;
+
+    // Returns nullptr if the word does not occur in any document; a word
+    // present in the term dictionary always has postings
+    const PostingList* FindPostings(std::string_view word) const;
+
+    bool ContainsWord(std::string_view word, int document_id) const;
+
+    // The term must occur in at least one document
+    double ComputeWordInverseDocumentFreq(TermId term_id) const;
+
+    // Inverse document frequency of query.plus_words[word_index]
+    double GetInverseDocumentFreq(const Query& query, size_t word_index, TermId term_id) const {
+        return query.plus_word_inverse_document_freqs.empty()
+            ? ComputeWordInverseDocumentFreq(term_id)
+            : query.plus_word_inverse_document_freqs[word_index];
+    }
 
+    // Returns the options.max_result_count most relevant matching documents
     template <typename DocumentPredicate>
     std::vector<Document> FindAllDocuments(const Query& query,
-        DocumentPredicate document_predicate) const;
+        DocumentPredicate document_predicate, const SearchOptions& options) const;
 
     template <typename DocumentPredicate>
     std::vector<Document> FindAllDocuments(const std::execution::sequenced_policy& policy, const Query& query,
-        DocumentPredicate document_predicate) const;
+        DocumentPredicate document_predicate, const SearchOptions& options) const;
 
     template <typename DocumentPredicate>
     std::vector<Document> FindAllDocuments(const std::execution::parallel_policy& policy, const Query& query,
-        DocumentPredicate document_predicate) const;
-};
+        DocumentPredicate document_predicate, const SearchOptions& options) const;
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query,
-    DocumentPredicate document_predicate) const {
-    const auto query = ParseQuery(raw_query);
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindFilteredDocuments(const ExecutionPolicy& policy, const Query& query,
+        const DocumentFilter& filter, const SearchOptions& options) const;
+
+    // The predicate applied to the attributes of the document with the ordinal;
+    // a status predicate compiles to a single comparison and a filter to a bit test
+    template <typename DocumentPredicate>
+    bool IsAccepted(const DocumentPredicate& document_predicate, int document_id, int ordinal) const {
+        if constexpr (std::is_same_v<DocumentPredicate, DocumentStatusPredicate>) {
+            return document_attributes_.GetStatus(ordinal) == document_predicate.status;
+        }
+        else if constexpr (std::is_same_v<DocumentPredicate, CandidateOrdinals>) {
+            return document_predicate.Contains(ordinal);
+        }
+        else {
+            return document_predicate(document_id, document_attributes_.GetStatus(ordinal),
+                document_attributes_.GetRating(ordinal));
+        }
+    }
 
-    auto matched_documents = FindAllDocuments(query, document_predicate);
+    // Documents containing any minus word, collected in the set of the calling thread
+    // Replaces the contents of excluded_documents
+    void FindExcludedDocuments(const Query& query, DocumentIdSet& excluded_documents) const;
 
-    sort(matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-            const double MIN_DIFFERENCE_RELEVANCE = 1e-6;
-    if (std::abs(lhs.relevance - rhs.relevance) < MIN_DIFFERENCE_RELEVANCE) {
-        return lhs.rating > rhs.rating;
+    // Scores the documents with ids in [first_document_id, last_document_id]
+    // in the accumulator of the calling thread
+    template <typename DocumentPredicate>
+    TopDocuments FindDocumentsInRange(const Query& query, DocumentPredicate document_predicate,
+        size_t max_result_count, const DocumentIdSet& excluded_documents,
+        int first_document_id, int last_document_id) const;
+
+    // MaxScore document-at-a-time retrieval over the documents with ids in
+    // [first_document_id, last_document_id]
+    template <typename DocumentPredicate>
+    TopDocuments FindDocumentsPruned(const Query& query, DocumentPredicate document_predicate,
+        size_t max_result_count, const DocumentIdSet& excluded_documents,
+        int first_document_id, int last_document_id) const;
+};
+
+template <typename ExecutionPolicy>
+void SearchServer::AddDocuments(const ExecutionPolicy& policy, const std::vector<NewDocument>& documents) {
+    CheckNewDocumentIds(documents);
+
+    // Parallel algorithms terminate on exceptions, so tokenization errors are
+    // collected and rethrown before anything is indexed
+    std::vector<std::vector<DocumentTerm>> document_terms(documents.size());
+    std::vector<uint64_t> fingerprints(documents.size());
+    std::vector<std::exception_ptr> errors(documents.size());
+    std::vector<size_t> indexes(documents.size());
+    std::iota(indexes.begin(), indexes.end(), size_t{ 0 });
+    std::for_each(
+        policy,
+        indexes.begin(), indexes.end(),
+        [this, &documents, &document_terms, &fingerprints, &errors](size_t index) {
+            try {
+                document_terms[index] = ComputeDocumentTerms(documents[index].text);
+                if (duplicate_detection_ != DuplicateDetection::DISABLED) {
+                    fingerprints[index] = ComputeContentFingerprint(document_terms[index]);
+                }
+            }
+            catch (...) {
+                errors[index] = std::current_exception();
+            }
+        }
+    );
+    for (const std::exception_ptr& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
     }
-    else {
-        return lhs.relevance > rhs.relevance;
+    CheckNewDocumentDuplicates(document_terms, fingerprints);
+
+    std::vector<TermPosting> postings;
+    for (size_t index = 0; index < documents.size(); ++index) {
+        const NewDocument& document = documents[index];
+        const int ordinal = document_attributes_.Add(document.id, document.status,
+            ComputeAverageRating(document.ratings));
+        auto& terms = frequencies_words_in_documents_[document.id];
+        terms.reserve(document_terms[index].size());
+        for (const auto& [word, term_freq, frequency] : document_terms[index]) {
+            const TermId term_id = term_dictionary_.Intern(word);
+            postings.push_back({ term_id, document.id, ordinal, term_freq });
+            terms.emplace_back(term_id, frequency);
+        }
+        document_ids_.emplace(document.id);
+        if (duplicate_detection_ != DuplicateDetection::DISABLED) {
+            duplicate_index_.Add(fingerprints[index], document.id);
+        }
+    }
+    word_to_document_freqs_.Add(policy, postings);
+    inverse_document_freqs_.Reserve(term_dictionary_.GetIdBound());
+    OnIndexChanged();
+}
+
+template <typename ExecutionPolicy>
+void SearchServer::RemoveDocuments(const ExecutionPolicy& policy, const std::vector<int>& document_ids) {
+    std::vector<int> removed_ids;
+    removed_ids.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        if (document_attributes_.Contains(document_id)) {
+            removed_ids.push_back(document_id);
+        }
+    }
+    std::sort(removed_ids.begin(), removed_ids.end());
+    removed_ids.erase(std::unique(removed_ids.begin(), removed_ids.end()), removed_ids.end());
+    if (removed_ids.empty()) {
+        return;
     }
-        });
-    const int MAX_RESULT_DOCUMENT_COUNT = 5;
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+
+    std::vector<TermPosting> postings;
+    for (const int document_id : removed_ids) {
+        for (const auto& [term_id, frequency] : frequencies_words_in_documents_.at(document_id)) {
+            postings.push_back({ term_id, document_id, -1, 0.0 });
+        }
+    }
+    word_to_document_freqs_.Remove(policy, postings);
+
+    for (const int document_id : removed_ids) {
+        RemoveDocumentFingerprint(document_id);
+        for (const auto& [term_id, frequency] : frequencies_words_in_documents_.at(document_id)) {
+            term_dictionary_.Release(term_id);
+        }
+        frequencies_words_in_documents_.erase(document_id);
+        document_attributes_.Remove(document_id);
+        document_ids_.erase(document_id);
     }
+    OnIndexChanged();
+}
 
-    return matched_documents;
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query,
+    DocumentPredicate document_predicate) const {
+    return FindTopDocuments(raw_query, document_predicate, SearchOptions{});
 }
 
 template <typename DocumentPredicate>
@@ -244,109 +545,314 @@ std::vector<Document> SearchServer::FindTopDocuments(const std::execution::seque
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy& policy, const std::string_view& raw_query,
     DocumentPredicate document_predicate) const {
+    return FindTopDocuments(policy, raw_query, document_predicate, SearchOptions{});
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query,
+    DocumentPredicate document_predicate, const SearchOptions& options) const {
+    const ScratchLease<Query> query;
+    ParseQuery(raw_query, *query);
+    return FindAllDocuments(*query, document_predicate, options);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const std::execution::sequenced_policy& policy,
+    const std::string_view& raw_query, DocumentPredicate document_predicate, const SearchOptions& options) const {
+    return FindTopDocuments(raw_query, document_predicate, options);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const std::execution::parallel_policy& policy,
+    const std::string_view& raw_query, DocumentPredicate document_predicate, const SearchOptions& options) const {
     const auto query = ParseQuery(raw_query);
+    return FindAllDocuments(policy, query, document_predicate, options);
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocumentsCached(const ExecutionPolicy& policy, const Query& query,
+    DocumentStatus status, bool& from_cache) const {
+    const DocumentStatusPredicate document_predicate{ status };
+    from_cache = false;
+    if (result_cache_->GetCapacity() == 0) {
+        return FindAllDocuments(policy, query, document_predicate, SearchOptions{});
+    }
+    const std::string key = MakeResultCacheKey(query, status);
+    if (auto cached = result_cache_->Find(key, index_generation_)) {
+        AddQueryCounter(QueryCounter::RESULT_CACHE_HITS, 1);
+        from_cache = true;
+        return std::move(*cached);
+    }
+    AddQueryCounter(QueryCounter::RESULT_CACHE_MISSES, 1);
+    std::vector<Document> documents = FindAllDocuments(policy, query, document_predicate, SearchOptions{});
+    result_cache_->Insert(key, index_generation_, documents);
+    return documents;
+}
 
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindAllDocuments(const Query& query,
+    DocumentPredicate document_predicate, const SearchOptions& options) const {
+    const ScratchLease<DocumentIdSet> excluded_documents;
+    FindExcludedDocuments(query, *excluded_documents);
+    TopDocuments top_documents = options.retrieval_mode == RetrievalMode::MAX_SCORE
+        ? FindDocumentsPruned(query, document_predicate, options.max_result_count, *excluded_documents,
+            0, std::numeric_limits<int>::max())
+        : FindDocumentsInRange(query, document_predicate, options.max_result_count, *excluded_documents,
+            0, std::numeric_limits<int>::max());
+    PhaseTimer timer(QueryPhase::RESULT_BUILD);
+    return top_documents.Extract();
+}
 
-    sort(
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindAllDocuments(const std::execution::sequenced_policy& policy, const Query& query,
+    DocumentPredicate document_predicate, const SearchOptions& options) const {
+    return FindAllDocuments(query, document_predicate, options);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindAllDocuments(const std::execution::parallel_policy& policy, const Query& query,
+    DocumentPredicate document_predicate, const SearchOptions& options) const {
+    // The executor already keeps every hardware thread busy with other queries
+    if (QueryExecutor::IsWorkerThread()) {
+        return FindAllDocuments(query, document_predicate, options);
+    }
+
+    // Every stripe owns a disjoint range of document ids, so stripes are
+    // scored without synchronization and each document sums its words in
+    // query order. Posting lists are sorted by id, so a stripe skips straight
+    // to its range and every posting is visited once in total.
+    std::vector<int> stripes(std::max(1u, std::thread::hardware_concurrency()));
+    std::iota(stripes.begin(), stripes.end(), 0);
+    const int stripe_count = static_cast<int>(stripes.size());
+
+    // Computed in 64 bits, as ranges near INT_MAX would overflow an int
+    const int first_document_id = document_ids_.empty() ? 0 : *document_ids_.begin();
+    const int last_document_id = document_ids_.empty() ? 0 : *document_ids_.rbegin();
+    const int64_t range_size = (int64_t{ last_document_id } - first_document_id) / stripe_count + 1;
+
+    // Built on the calling thread and only read by the workers
+    const ScratchLease<DocumentIdSet> excluded_documents;
+    FindExcludedDocuments(query, *excluded_documents);
+
+    TopDocuments top_documents = std::transform_reduce(
         policy,
-        matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-            const double MIN_DIFFERENCE_RELEVANCE = 1e-6;
-    if (std::abs(lhs.relevance - rhs.relevance) < MIN_DIFFERENCE_RELEVANCE) {
-        return lhs.rating > rhs.rating;
+        stripes.begin(), stripes.end(),
+        TopDocuments(options.max_result_count),
+        [](TopDocuments lhs, const TopDocuments& rhs) {
+            PhaseTimer timer(QueryPhase::TOP_K);
+            lhs.Merge(rhs);
+            return lhs;
+        },
+        [&](int stripe) {
+            const int64_t range_begin = first_document_id + stripe * range_size;
+            if (range_begin > last_document_id) {
+                return TopDocuments(options.max_result_count);
+            }
+            const int64_t range_end = std::min<int64_t>(range_begin + range_size - 1, last_document_id);
+            if (options.retrieval_mode == RetrievalMode::MAX_SCORE) {
+                return FindDocumentsPruned(query, document_predicate, options.max_result_count, *excluded_documents,
+                    static_cast<int>(range_begin), static_cast<int>(range_end));
+            }
+            return FindDocumentsInRange(query, document_predicate, options.max_result_count, *excluded_documents,
+                static_cast<int>(range_begin), static_cast<int>(range_end));
+        }
+    );
+    PhaseTimer timer(QueryPhase::RESULT_BUILD);
+    return top_documents.Extract();
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindFilteredDocuments(const ExecutionPolicy& policy, const Query& query,
+    const DocumentFilter& filter, const SearchOptions& options) const {
+    size_t posting_count = 0;
+    for (const std::string_view word : query.plus_words) {
+        if (const PostingList* postings = FindPostings(word)) {
+            posting_count += postings->size();
+        }
     }
-    else {
-        return lhs.relevance > rhs.relevance;
+    if (posting_count * ORDINALS_PER_POSTING_FOR_FILTER_SCAN < document_attributes_.GetOrdinalBound()) {
+        return FindAllDocuments(policy, query, filter, options);
     }
-        });
-    const int MAX_RESULT_DOCUMENT_COUNT = 5;
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+    // The bitset is only read by the search, so the calling thread's one is
+    // shared with the parallel scoring
+    const ScratchLease<std::vector<uint64_t>> candidates;
+    {
+        PhaseTimer timer(QueryPhase::FILTERING);
+        document_attributes_.Filter(filter, *candidates);
     }
-
-    return matched_documents;
+    return FindAllDocuments(policy, query, CandidateOrdinals{ candidates->data() }, options);
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const Query& query,
-    DocumentPredicate document_predicate) const {
-    std::map<int, double> document_to_relevance;
-    for (const std::string_view& word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+TopDocuments SearchServer::FindDocumentsInRange(const Query& query, DocumentPredicate document_predicate,
+    size_t max_result_count, const DocumentIdSet& excluded_documents,
+    int first_document_id, int last_document_id) const {
+    const ScratchLease<ScoreAccumulator> accumulator;
+    ScoreAccumulator& document_to_relevance = *accumulator;
+    document_to_relevance.Reset(document_attributes_.GetOrdinalBound());
+
+    std::optional<PhaseTimer> timer(std::in_place, QueryPhase::POSTING_TRAVERSAL);
+    uint64_t postings_scanned = 0;
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        const auto term_id = term_dictionary_.Find(query.plus_words[i]);
+        if (!term_id) {
             continue;
         }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+        const double inverse_document_freq = GetInverseDocumentFreq(query, i, *term_id);
+        DocumentIdSet::Cursor excluded = excluded_documents.MakeCursor();
+        const PostingList* postings = word_to_document_freqs_.Find(*term_id);
+        const PostingList::Iterator end = postings->end();
+        PostingList::Iterator posting = postings->begin();
+        posting.SkipTo(first_document_id);
+        for (; posting != end; ++posting) {
+            const auto [document_id, term_freq] = *posting;
+            if (document_id > last_document_id) {
+                break;
+            }
+            ++postings_scanned;
+            if (excluded.Contains(document_id)) {
+                continue;
+            }
+            const int ordinal = posting.Ordinal();
+            if (IsAccepted(document_predicate, document_id, ordinal)) {
+                document_to_relevance.Add(ordinal, term_freq * inverse_document_freq);
             }
         }
     }
 
-    for (const std::string_view& word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+    AddQueryCounter(QueryCounter::POSTINGS_SCANNED, postings_scanned);
+
+    timer.emplace(QueryPhase::TOP_K);
+    TopDocuments top_documents(max_result_count);
+    uint64_t documents_scored = 0;
+    document_to_relevance.ForEach([&](int ordinal, double relevance) {
+        const int document_id = document_attributes_.GetDocumentId(ordinal);
+        top_documents.Add({ document_id, relevance, document_attributes_.GetRating(ordinal) });
+        ++documents_scored;
+    });
+    AddQueryCounter(QueryCounter::DOCUMENTS_SCORED, documents_scored);
+    return top_documents;
+}
+
+template <typename DocumentPredicate>
+TopDocuments SearchServer::FindDocumentsPruned(const Query& query, DocumentPredicate document_predicate,
+    size_t max_result_count, const DocumentIdSet& excluded_documents,
+    int first_document_id, int last_document_id) const {
+    struct TermCursor {
+        PostingList::Iterator current;
+        PostingList::Iterator end;
+        double inverse_document_freq;
+        double max_contribution;
+        size_t query_position;
+    };
+
+    TopDocuments top_documents(max_result_count);
+    if (max_result_count == 0) {
+        return top_documents;
+    }
+
+    // Selection is interleaved with the traversal, so both are timed together
+    PhaseTimer timer(QueryPhase::POSTING_TRAVERSAL);
+    uint64_t postings_scanned = 0;
+    uint64_t documents_scored = 0;
+    std::vector<TermCursor> terms;
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        const auto term_id = term_dictionary_.Find(query.plus_words[i]);
+        if (!term_id) {
             continue;
         }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
-        }
+        const PostingList* postings = word_to_document_freqs_.Find(*term_id);
+        const double inverse_document_freq = GetInverseDocumentFreq(query, i, *term_id);
+        TermCursor term{ postings->begin(), postings->end(), inverse_document_freq,
+            postings->max_term_freq() * inverse_document_freq, i };
+        term.current.SkipTo(first_document_id);
+        terms.push_back(term);
     }
-
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back(
-            { document_id, relevance, documents_.at(document_id).rating });
+    std::sort(terms.begin(), terms.end(), [](const TermCursor& lhs, const TermCursor& rhs) {
+        return lhs.max_contribution < rhs.max_contribution;
+    });
+
+    // max_contribution_sums[i] bounds the score a document gets from terms[0, i)
+    std::vector<double> max_contribution_sums(terms.size() + 1, 0.0);
+    for (size_t i = 0; i < terms.size(); ++i) {
+        max_contribution_sums[i + 1] = max_contribution_sums[i] + terms[i].max_contribution;
     }
-    return matched_documents;
-}
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const std::execution::sequenced_policy& policy, const Query& query,
-    DocumentPredicate document_predicate) const {
-    return FindAllDocuments(query, document_predicate);
-}
+    DocumentIdSet::Cursor excluded = excluded_documents.MakeCursor();
+
+    std::vector<double> contributions(query.plus_words.size());
+    std::vector<bool> has_contribution(query.plus_words.size());
+    // Terms [0, first_essential) can't bring a document into the top on their
+    // own, so only the remaining terms propose candidates
+    size_t first_essential = 0;
+    while (true) {
+        // A document may displace the worst kept one only when its relevance
+        // is above the worst one minus MIN_DIFFERENCE_RELEVANCE; the doubled
+        // margin absorbs rounding of the bounds
+        const double threshold = top_documents.IsFull()
+            ? top_documents.Worst().relevance - 2 * MIN_DIFFERENCE_RELEVANCE
+            : -std::numeric_limits<double>::infinity();
+        while (first_essential < terms.size() && max_contribution_sums[first_essential + 1] < threshold) {
+            ++first_essential;
+        }
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const std::execution::parallel_policy& policy, const Query& query,
-    DocumentPredicate document_predicate) const {
-    ConcurrentMap<int, double> document_to_relevance(100);
+        bool has_candidate = false;
+        int document_id = 0;
+        for (size_t i = first_essential; i < terms.size(); ++i) {
+            if (terms[i].current != terms[i].end && (!has_candidate || (*terms[i].current).first < document_id)) {
+                document_id = (*terms[i].current).first;
+                has_candidate = true;
+            }
+        }
+        if (!has_candidate || document_id > last_document_id) {
+            break;
+        }
 
-    std::for_each(
-        std::execution::par,
-        query.plus_words.cbegin(), query.plus_words.cend(),
-        [&](const std::string_view& word) {
-            if (word_to_document_freqs_.count(word) != 0)
-            {
-                for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                    const auto& document_data = documents_.at(document_id);
-                    if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                        document_to_relevance[document_id].ref_to_value += term_freq * ComputeWordInverseDocumentFreq(word);
-                    }
-                }
-            };
+        double score_bound = max_contribution_sums[first_essential];
+        for (size_t i = first_essential; i < terms.size(); ++i) {
+            if (terms[i].current != terms[i].end && (*terms[i].current).first == document_id) {
+                score_bound += (*terms[i].current).second * terms[i].inverse_document_freq;
+            }
         }
-    );
 
-    std::for_each(
-        std::execution::par,
-        query.minus_words.cbegin(), query.minus_words.cend(),
-        [&](const std::string_view word) {
-            if (word_to_document_freqs_.count(word) != 0) {
-                for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                    document_to_relevance.Erase(document_id);
+        if (score_bound >= threshold && !excluded.Contains(document_id)) {
+            std::fill(has_contribution.begin(), has_contribution.end(), false);
+            // The candidate came from an essential term, so some posting gives the ordinal
+            int ordinal = -1;
+            for (size_t i = 0; i < terms.size(); ++i) {
+                if (i < first_essential) {
+                    terms[i].current.SkipTo(document_id);
+                }
+                if (terms[i].current != terms[i].end && (*terms[i].current).first == document_id) {
+                    contributions[terms[i].query_position] = (*terms[i].current).second * terms[i].inverse_document_freq;
+                    has_contribution[terms[i].query_position] = true;
+                    ordinal = terms[i].current.Ordinal();
                 }
             }
+
+            if (IsAccepted(document_predicate, document_id, ordinal)) {
+                // Summed in query word order, exactly as the exhaustive scoring does
+                double relevance = 0.0;
+                for (size_t i = 0; i < contributions.size(); ++i) {
+                    if (has_contribution[i]) {
+                        relevance += contributions[i];
+                    }
+                }
+                top_documents.Add({ document_id, relevance, document_attributes_.GetRating(ordinal) });
+                ++documents_scored;
+            }
         }
-    );
 
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance.BuildOrdinaryMap()) {
-        matched_documents.push_back(
-            { document_id, relevance, documents_.at(document_id).rating });
+        for (size_t i = first_essential; i < terms.size(); ++i) {
+            if (terms[i].current != terms[i].end && (*terms[i].current).first == document_id) {
+                ++terms[i].current;
+                ++postings_scanned;
+            }
+        }
     }
-    return matched_documents;
+    AddQueryCounter(QueryCounter::POSTINGS_SCANNED, postings_scanned);
+    AddQueryCounter(QueryCounter::DOCUMENTS_SCORED, documents_scored);
+    return top_documents;
 }
 
 void AddDocument(SearchServer& search_server, int document_id, const std::string_view& document, DocumentStatus status,
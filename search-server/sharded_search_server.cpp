@@ -0,0 +1,67 @@
+#include "sharded_search_server.h"
+
+#include <cmath>
+#include <stdexcept>
+
+void ShardedSearchServer::AddDocument(int document_id, const std::string_view& document, DocumentStatus status,
+    const std::vector<int>& ratings) {
+    if (document_id < 0) {
+        throw std::invalid_argument("Invalid document_id");
+    }
+    shards_[document_id % shards_.size()].AddDocument(document_id, document, status, ratings);
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    if (document_id < 0) {
+        return;
+    }
+    shards_[document_id % shards_.size()].RemoveDocument(document_id);
+}
+
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::string_view& raw_query,
+    DocumentStatus status) const {
+    return FindTopDocuments(raw_query, DocumentStatusPredicate{ status });
+}
+
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::string_view& raw_query) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(
+    const std::string_view& raw_query, int document_id) const {
+    return GetShardOf(document_id).MatchDocument(raw_query, document_id);
+}
+
+size_t ShardedSearchServer::GetDocumentCount() const {
+    size_t document_count = 0;
+    for (const SearchServer& shard : shards_) {
+        document_count += shard.GetDocumentCount();
+    }
+    return document_count;
+}
+
+const SearchServer& ShardedSearchServer::GetShardOf(int document_id) const {
+    if (document_id < 0) {
+        throw std::out_of_range("");
+    }
+    return shards_[document_id % shards_.size()];
+}
+
+SearchServer::Query ShardedSearchServer::ParseQuery(const std::string_view& raw_query) const {
+    // Shards share the stop words, so any of them parses the same way
+    SearchServer::Query query = shards_.front().ParseQuery(raw_query);
+    const size_t document_count = GetDocumentCount();
+    query.plus_word_inverse_document_freqs.reserve(query.plus_words.size());
+    for (const std::string_view& word : query.plus_words) {
+        size_t document_freq = 0;
+        for (const SearchServer& shard : shards_) {
+            const PostingList* postings = shard.FindPostings(word);
+            document_freq += postings ? postings->size() : 0;
+        }
+        // Same expression as SearchServer::ComputeWordInverseDocumentFreq, so
+        // the scores match those of a single server bit for bit
+        query.plus_word_inverse_document_freqs.push_back(
+            document_freq == 0 ? 0.0 : log(document_count * 1.0 / document_freq));
+    }
+    return query;
+}
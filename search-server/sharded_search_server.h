@@ -0,0 +1,84 @@
+#pragma once
+
+#include "document.h"
+#include "search_server.h"
+#include "query_executor.h"
+#include "top_documents.h"
+
+#include <cstddef>
+#include <stdexcept>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+// Search server that partitions documents over several SearchServer
+// shards by id. A query is parsed once, scored on all shards in parallel
+// with inverse document frequencies aggregated over the whole corpus, and
+// the top documents of the shards are merged, so results equal those of a
+// single server holding every document.
+class ShardedSearchServer {
+public:
+    template <typename StopWords>
+    ShardedSearchServer(const StopWords& stop_words, size_t shard_count) {
+        if (shard_count == 0) {
+            throw std::invalid_argument("Shard count must be positive");
+        }
+        shards_.reserve(shard_count);
+        for (size_t shard = 0; shard < shard_count; ++shard) {
+            shards_.emplace_back(stop_words);
+        }
+    }
+
+    void AddDocument(int document_id, const std::string_view& document, DocumentStatus status,
+        const std::vector<int>& ratings);
+
+    void RemoveDocument(int document_id);
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::string_view& raw_query,
+        DocumentPredicate document_predicate, const SearchOptions& options = SearchOptions{}) const;
+
+    std::vector<Document> FindTopDocuments(const std::string_view& raw_query, DocumentStatus status) const;
+
+    std::vector<Document> FindTopDocuments(const std::string_view& raw_query) const;
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view& raw_query,
+        int document_id) const;
+
+    size_t GetDocumentCount() const;
+
+    size_t GetShardCount() const {
+        return shards_.size();
+    }
+
+    const SearchServer& GetShard(size_t shard) const {
+        return shards_.at(shard);
+    }
+
+private:
+    const SearchServer& GetShardOf(int document_id) const;
+
+    // Parses the query and fills in the inverse document frequencies of its
+    // plus words over all shards
+    SearchServer::Query ParseQuery(const std::string_view& raw_query) const;
+
+    std::vector<SearchServer> shards_;
+};
+
+template <typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(const std::string_view& raw_query,
+    DocumentPredicate document_predicate, const SearchOptions& options) const {
+    const SearchServer::Query query = ParseQuery(raw_query);
+    std::vector<std::vector<Document>> shard_documents(shards_.size());
+    QueryExecutor::GetDefault().ForEach(shards_.size(), [&](size_t shard) {
+        shard_documents[shard] = shards_[shard].FindAllDocuments(query, document_predicate, options);
+    });
+
+    TopDocuments top_documents(options.max_result_count);
+    for (const std::vector<Document>& documents : shard_documents) {
+        for (const Document& document : documents) {
+            top_documents.Add(document);
+        }
+    }
+    return top_documents.Extract();
+}
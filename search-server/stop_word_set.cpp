@@ -0,0 +1,34 @@
+#include "stop_word_set.h"
+
+#include <functional>
+#include <stdexcept>
+
+StopWordSet::StopWordSet(const std::set<std::string, std::less<>>& words)
+    : size_(words.size()) {
+    if (words.empty()) {
+        return;
+    }
+    size_t slot_count = 2;
+    while (slot_count < 2 * words.size()) {
+        slot_count *= 2;
+    }
+    slots_.resize(slot_count);
+
+    for (const std::string& word : words) {
+        if (word.empty()) {
+            throw std::invalid_argument("Stop word is empty");
+        }
+        const Slot inserted{ static_cast<uint32_t>(chars_.size()), static_cast<uint32_t>(word.size()) };
+        chars_ += word;
+        size_t slot = Hash(word) & (slot_count - 1);
+        while (slots_[slot].length != 0) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        slots_[slot] = inserted;
+        length_mask_ |= uint64_t{ 1 } << GetLengthBit(word.size());
+    }
+}
+
+size_t StopWordSet::Hash(std::string_view word) {
+    return std::hash<std::string_view>{}(word);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Immutable hash set of stop words for lookups by string_view.
+// The words are packed into one buffer and found through an open-addressing
+// table at most half full. A mask of the word lengths present rejects most
+// other words before they are hashed.
+class StopWordSet {
+public:
+    StopWordSet() = default;
+
+    // The words must not be empty
+    explicit StopWordSet(const std::set<std::string, std::less<>>& words);
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool Contains(std::string_view word) const {
+        if (((length_mask_ >> GetLengthBit(word.size())) & 1) == 0) {
+            return false;
+        }
+        for (size_t slot = Hash(word) & (slots_.size() - 1); slots_[slot].length != 0;
+            slot = (slot + 1) & (slots_.size() - 1)) {
+            if (GetWord(slots_[slot]) == word) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    // Words are referenced by offset, so the set stays valid when moved
+    struct Slot {
+        uint32_t offset = 0;
+        // Zero for empty slots
+        uint32_t length = 0;
+    };
+
+    static size_t GetLengthBit(size_t length) {
+        return length < 64 ? length : 63;
+    }
+
+    static size_t Hash(std::string_view word);
+
+    std::string_view GetWord(const Slot& slot) const {
+        return std::string_view(chars_).substr(slot.offset, slot.length);
+    }
+
+    std::string chars_;
+    std::vector<Slot> slots_;
+    uint64_t length_mask_ = 0;
+    size_t size_ = 0;
+};
@@ -4,9 +4,88 @@
 #include <vector>
 #include <set>
 #include <list>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace string_processing_detail {
+
+struct ByteMasks {
+    uint32_t spaces;
+    uint32_t control_chars;
+};
+
+const size_t SCAN_BLOCK_SIZE = 16;
+
+// Bit i of the masks is set if data[i] is a space or a control character
+inline ByteMasks ScanBlock(const char* data) {
+#ifdef __SSE2__
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    const __m128i spaces = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+    const __m128i control_chars = _mm_and_si128(
+        _mm_cmplt_epi8(bytes, _mm_set1_epi8(' ')), _mm_cmpgt_epi8(bytes, _mm_set1_epi8(-1)));
+    return { static_cast<uint32_t>(_mm_movemask_epi8(spaces)),
+        static_cast<uint32_t>(_mm_movemask_epi8(control_chars)) };
+#else
+    ByteMasks masks{ 0, 0 };
+    for (size_t i = 0; i < SCAN_BLOCK_SIZE; ++i) {
+        masks.spaces |= static_cast<uint32_t>(data[i] == ' ') << i;
+        masks.control_chars |= static_cast<uint32_t>(data[i] >= '\0' && data[i] < ' ') << i;
+    }
+    return masks;
+#endif
+}
+
+}  // namespace string_processing_detail
+
+// Calls on_word(word, has_control_chars) for every word of text in order.
+// Words are separated by single spaces, so adjacent spaces produce empty
+// words. The text is scanned once, a block of bytes at a time, for both
+// spaces and control characters.
+template <typename WordFunc>
+void ForEachWord(const std::string_view& text, WordFunc on_word) {
+    using namespace string_processing_detail;
+
+    size_t word_begin = 0;
+    bool has_control_chars = false;
+    size_t block = 0;
+    for (; block + SCAN_BLOCK_SIZE <= text.size(); block += SCAN_BLOCK_SIZE) {
+        auto [spaces, control_chars] = ScanBlock(text.data() + block);
+        while (spaces != 0) {
+            const int space = std::countr_zero(spaces);
+            const uint32_t before_space = (uint32_t{ 1 } << space) - 1;
+            has_control_chars = has_control_chars || (control_chars & before_space) != 0;
+            control_chars &= ~before_space;
+            on_word(text.substr(word_begin, block + space - word_begin), has_control_chars);
+            word_begin = block + space + 1;
+            has_control_chars = false;
+            spaces &= spaces - 1;
+        }
+        has_control_chars = has_control_chars || control_chars != 0;
+    }
+    for (size_t i = block; i < text.size(); ++i) {
+        if (text[i] == ' ') {
+            on_word(text.substr(word_begin, i - word_begin), has_control_chars);
+            word_begin = i + 1;
+            has_control_chars = false;
+        }
+        else if (text[i] >= '\0' && text[i] < ' ') {
+            has_control_chars = true;
+        }
+    }
+    on_word(text.substr(word_begin), has_control_chars);
+}
 
 std::vector<std::string_view> SplitIntoWords(const std::string_view& text);
 
+// Replaces the contents of words, reusing their storage
+void SplitIntoWords(const std::string_view& text, std::vector<std::string_view>& words);
+
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     std::set<std::string, std::less<>> non_empty_strings;
@@ -0,0 +1,107 @@
+#include "term_dictionary.h"
+
+#include <algorithm>
+
+TermId TermDictionary::Intern(std::string_view term, uint32_t reference_count) {
+    if (const auto it = ids_.find(term); it != ids_.end()) {
+        reference_counts_[it->second] += reference_count;
+        return it->second;
+    }
+
+    TermId term_id;
+    if (free_ids_.empty()) {
+        term_id = static_cast<TermId>(terms_.size());
+        terms_.emplace_back();
+        reference_counts_.push_back(0);
+        term_chunks_.push_back(NO_CHUNK);
+    }
+    else {
+        term_id = free_ids_.back();
+        free_ids_.pop_back();
+    }
+
+    const auto [stored, chunk] = Store(term);
+    terms_[term_id] = stored;
+    term_chunks_[term_id] = chunk;
+    reference_counts_[term_id] = reference_count;
+    ids_.emplace(stored, term_id);
+    return term_id;
+}
+
+void TermDictionary::Release(TermId term_id) {
+    if (--reference_counts_[term_id] > 0) {
+        return;
+    }
+
+    const std::string_view term = terms_[term_id];
+    ids_.erase(term);
+    terms_[term_id] = {};
+    free_ids_.push_back(term_id);
+
+    const uint32_t chunk = term_chunks_[term_id];
+    term_chunks_[term_id] = NO_CHUNK;
+    if (chunk == NO_CHUNK) {
+        return;
+    }
+    chunks_[chunk].live_bytes -= term.size();
+    // The chunk being filled is kept for the next terms
+    if (chunks_[chunk].live_bytes == 0 && chunk != chunk_) {
+        chunks_[chunk].data.reset();
+        free_chunks_.push_back(chunk);
+    }
+}
+
+std::optional<TermId> TermDictionary::Find(std::string_view term) const {
+    const auto it = ids_.find(term);
+    if (it == ids_.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+std::pair<std::string_view, uint32_t> TermDictionary::Store(std::string_view term) {
+    if (term.empty()) {
+        return { {}, NO_CHUNK };
+    }
+
+    uint32_t chunk = 0;
+    char* data = nullptr;
+    if (term.size() > CHUNK_SIZE / 4) {
+        // Long terms get a chunk of their own and keep the shared one usable
+        chunk = AddChunk(term.size());
+        data = chunks_[chunk].data.get();
+    }
+    else {
+        if (chunk_offset_ + term.size() > CHUNK_SIZE) {
+            const uint32_t previous_chunk = chunk_;
+            chunk_ = AddChunk(CHUNK_SIZE);
+            chunk_offset_ = 0;
+            // A filled chunk whose terms are all gone is no longer kept for new ones
+            if (previous_chunk != NO_CHUNK && chunks_[previous_chunk].live_bytes == 0) {
+                chunks_[previous_chunk].data.reset();
+                free_chunks_.push_back(previous_chunk);
+            }
+        }
+        chunk = chunk_;
+        data = chunks_[chunk].data.get() + chunk_offset_;
+        chunk_offset_ += term.size();
+    }
+    chunks_[chunk].live_bytes += term.size();
+    std::copy(term.begin(), term.end(), data);
+    return { { data, term.size() }, chunk };
+}
+
+uint32_t TermDictionary::AddChunk(size_t size) {
+    uint32_t chunk;
+    if (free_chunks_.empty()) {
+        chunk = static_cast<uint32_t>(chunks_.size());
+        chunks_.emplace_back();
+    }
+    else {
+        chunk = free_chunks_.back();
+        free_chunks_.pop_back();
+    }
+    chunks_[chunk].data = std::make_unique<char[]>(size);
+    chunks_[chunk].live_bytes = 0;
+    return chunk;
+}
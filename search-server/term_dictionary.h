@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using TermId = uint32_t;
+
+// Stores every distinct term once and numbers terms densely.
+// Term text lives in arena chunks and never moves; a term is reference
+// counted by the documents containing it, and when the last one goes away
+// its id is reused. A chunk is freed once none of its terms is live.
+class TermDictionary {
+public:
+    TermDictionary() = default;
+
+    // Views into the arena stay valid when the dictionary is moved
+    TermDictionary(const TermDictionary&) = delete;
+    TermDictionary& operator=(const TermDictionary&) = delete;
+    TermDictionary(TermDictionary&&) = default;
+    TermDictionary& operator=(TermDictionary&&) = default;
+
+    // Returns the id of the term, adding it if needed, and takes
+    // reference_count references to it
+    TermId Intern(std::string_view term, uint32_t reference_count = 1);
+
+    // Drops a reference taken by Intern()
+    void Release(TermId term_id);
+
+    std::optional<TermId> Find(std::string_view term) const;
+
+    // The view stays valid until the term is released
+    std::string_view GetTerm(TermId term_id) const {
+        return terms_[term_id];
+    }
+
+    // Number of live terms
+    size_t size() const {
+        return ids_.size();
+    }
+
+    // Upper bound of the live term ids
+    size_t GetIdBound() const {
+        return terms_.size();
+    }
+
+private:
+    inline static const size_t CHUNK_SIZE = 64 * 1024;
+    inline static const uint32_t NO_CHUNK = UINT32_MAX;
+
+    struct Chunk {
+        std::unique_ptr<char[]> data;
+        size_t live_bytes = 0;
+    };
+
+    // Copies the term into a chunk and returns the copy and the chunk index
+    std::pair<std::string_view, uint32_t> Store(std::string_view term);
+
+    uint32_t AddChunk(size_t size);
+
+    std::unordered_map<std::string_view, TermId> ids_;
+    std::vector<std::string_view> terms_;
+    std::vector<uint32_t> reference_counts_;
+    std::vector<uint32_t> term_chunks_;
+    std::vector<TermId> free_ids_;
+
+    std::vector<Chunk> chunks_;
+    std::vector<uint32_t> free_chunks_;
+    // Chunk that new short terms are appended to
+    uint32_t chunk_ = NO_CHUNK;
+    size_t chunk_offset_ = CHUNK_SIZE;
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "term_dictionary.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+
+// Bijective 64-bit mixer (the splitmix64 finalizer)
+inline uint64_t MixBits(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xBF58476D1CE4E5B9ull;
+    value ^= value >> 27;
+    value *= 0x94D049BB133111EBull;
+    value ^= value >> 31;
+    return value;
+}
+
+inline uint64_t HashWord(std::string_view word) {
+    return MixBits(std::hash<std::string_view>{}(word));
+}
+
+// Order-independent fingerprint of a set of distinct elements given by
+// their hashes; equal sets always get equal fingerprints, and different
+// ones almost never do
+class SetFingerprint {
+public:
+    void Add(uint64_t element_hash) {
+        sum_ += element_hash;
+        mixed_xor_ ^= MixBits(element_hash);
+        ++size_;
+    }
+
+    uint64_t Get() const {
+        return MixBits(sum_ ^ (mixed_xor_ * 0x9E3779B97F4A7C15ull) ^ size_);
+    }
+
+private:
+    uint64_t sum_ = 0;
+    uint64_t mixed_xor_ = 0;
+    uint64_t size_ = 0;
+};
+
+inline uint64_t ComputeTermSetFingerprint(const TermId* first, const TermId* last) {
+    SetFingerprint fingerprint;
+    for (const TermId* term_id = first; term_id != last; ++term_id) {
+        fingerprint.Add(MixBits(*term_id + 1));
+    }
+    return fingerprint.Get();
+}
@@ -162,6 +162,21 @@ void TestFilterPredicateDocument() {
         ASSERT(top_docs.size() == 1);
         ASSERT(top_docs[0].id == 42);
     }
+
+    {
+        SearchServer server;
+        server.AddDocument(doc_id_2, content_2, DocumentStatus::ACTUAL, ratings_2);
+        server.AddDocument(doc_id_1, content_1, DocumentStatus::ACTUAL, ratings_1);
+        const auto expected = server.FindTopDocuments("in -funny"s);
+        // A predicate may search the same server while the outer search runs
+        const auto top_docs = server.FindTopDocuments("in -funny"s,
+            [&server](int document_id, DocumentStatus status, int rating) {
+                return server.FindTopDocuments("funny hair -cat"s).size() == 1;
+            });
+        ASSERT_EQUAL(top_docs.size(), expected.size());
+        ASSERT_EQUAL(top_docs[0].id, expected[0].id);
+        ASSERT_EQUAL(top_docs[0].relevance, expected[0].relevance);
+    }
 }
 
 void TestFilterStatusDocument() {
@@ -201,6 +216,1142 @@ void TestCorectCalculationRelevanceDocuments() {
     }
 }
 
+void TestInverseDocumentFreqCacheInvalidation() {
+    SearchServer server;
+    server.AddDocument(0, "cat in city"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(1, "dog in city"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "cat and dog"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(3, "bird in sky"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(4, "fish in sea"s, DocumentStatus::ACTUAL, { 1 });
+
+    const auto get_relevance = [&server](const std::string& query, int document_id) {
+        for (const Document& document : server.FindTopDocuments(query)) {
+            if (document.id == document_id) {
+                return document.relevance;
+            }
+        }
+        return -1.0;
+    };
+    const auto expected_relevance = [&server](int document_freq, double term_freq) {
+        return log(server.GetDocumentCount() * 1.0 / document_freq) * term_freq;
+    };
+
+    // Fills the cache
+    ASSERT_EQUAL(get_relevance("cat"s, 0), expected_relevance(2, 1.0 / 3));
+
+    server.AddDocument(5, "cat rat"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(get_relevance("cat"s, 0), expected_relevance(3, 1.0 / 3));
+
+    server.RemoveDocument(2);
+    ASSERT_EQUAL(get_relevance("cat"s, 0), expected_relevance(2, 1.0 / 3));
+
+    server.RemoveDocuments({ 3, 5 });
+    ASSERT_EQUAL(server.GetDocumentCount(), 3u);
+    ASSERT_EQUAL(get_relevance("cat"s, 0), expected_relevance(1, 1.0 / 3));
+
+    server.AddDocuments({ { 6, "cat owl"s, DocumentStatus::ACTUAL, { 1 } },
+        { 7, "owl eel"s, DocumentStatus::ACTUAL, { 1 } } });
+    ASSERT_EQUAL(get_relevance("cat"s, 0), expected_relevance(2, 1.0 / 3));
+
+    // Caches owl and eel, then frees their ids; the next new term takes one
+    // of them and must not see the value cached for the old term
+    ASSERT_EQUAL(get_relevance("owl"s, 7), expected_relevance(2, 0.5));
+    ASSERT_EQUAL(get_relevance("eel"s, 7), expected_relevance(1, 0.5));
+    server.RemoveDocuments({ 6, 7 });
+    server.AddDocument(8, "newt"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(get_relevance("newt"s, 8), expected_relevance(1, 1.0));
+    ASSERT_EQUAL(get_relevance("cat"s, 0), expected_relevance(1, 1.0 / 3));
+}
+
+void TestRemoveAndReAddDocument() {
+    SearchServer server;
+    for (int id = 10; id > 0; --id) {
+        server.AddDocument(id, "cat in the city"s, DocumentStatus::ACTUAL, { id });
+    }
+    server.RemoveDocument(3);
+    server.RemoveDocument(std::execution::par, 7);
+    ASSERT_EQUAL(server.GetDocumentCount(), 8u);
+    ASSERT(std::get<0>(server.MatchDocument("cat"s, 5)).size() == 1);
+
+    const auto found_docs = server.FindTopDocuments("cat"s);
+    ASSERT_EQUAL(found_docs.size(), 5u);
+    ASSERT_EQUAL(found_docs[0].id, 10);
+    ASSERT_EQUAL(found_docs[2].id, 8);
+
+    server.AddDocument(7, "dog in the city"s, DocumentStatus::ACTUAL, { 100 });
+    ASSERT_EQUAL(server.FindTopDocuments("dog"s).size(), 1u);
+    ASSERT_EQUAL(server.FindTopDocuments("city"s)[0].id, 7);
+
+    // Words of a document stay in place while other documents come and go
+    const auto word_frequencies = server.GetWordFrequencies(7);
+    for (int id = 100; id < 3000; ++id) {
+        server.AddDocument(id, "unique"s + std::to_string(id) + std::string(40, 'x'), DocumentStatus::ACTUAL, { 1 });
+    }
+    for (int id = 100; id < 3000; ++id) {
+        server.RemoveDocument(id);
+    }
+    ASSERT(word_frequencies == server.GetWordFrequencies(7));
+    ASSERT_EQUAL(word_frequencies.begin()->first, "city"s);
+}
+
+void TestMaxResultCount() {
+    SearchServer server;
+    for (int id = 0; id < 20; ++id) {
+        server.AddDocument(id, "cat in the city"s, DocumentStatus::ACTUAL, { id % 7 });
+    }
+    const auto any_document = [](int document_id, DocumentStatus status, int rating) { return true; };
+
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s).size(), 5u);
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s, any_document, SearchOptions{ 0 }).size(), 0u);
+
+    const auto top_docs = server.FindTopDocuments("cat"s, any_document, SearchOptions{ 8 });
+    const auto top_docs_par = server.FindTopDocuments(std::execution::par, "cat"s, any_document, SearchOptions{ 8 });
+    ASSERT_EQUAL(top_docs.size(), 8u);
+    ASSERT_EQUAL(top_docs_par.size(), 8u);
+    for (size_t i = 0; i < top_docs.size(); ++i) {
+        ASSERT_EQUAL(top_docs[i].id, top_docs_par[i].id);
+    }
+    ASSERT_EQUAL(top_docs[0].id, 6);
+    ASSERT_EQUAL(top_docs[1].id, 13);
+    ASSERT_EQUAL(top_docs[2].id, 5);
+    ASSERT_EQUAL(top_docs[3].id, 12);
+}
+
+void TestMaxScoreRetrieval() {
+    SearchServer server("and in"s);
+    server.AddDocument(0, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, { 8, -3 });
+    server.AddDocument(1, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    server.AddDocument(2, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+    server.AddDocument(3, "groomed starling eugene"s, DocumentStatus::BANNED, { 9 });
+    server.AddDocument(4, "fluffy cat in the city"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(5, "dog in the city"s, DocumentStatus::ACTUAL, { 3 });
+
+    const auto actual = [](int document_id, DocumentStatus status, int rating) {
+        return status == DocumentStatus::ACTUAL;
+    };
+    for (const std::string& query : { "fluffy groomed cat"s, "city dog -tail"s, "cat dog city -eyes"s }) {
+        for (size_t max_result_count = 1; max_result_count < 5; ++max_result_count) {
+            const auto expected = server.FindTopDocuments(query, actual, SearchOptions{ max_result_count });
+            const auto pruned = server.FindTopDocuments(query, actual,
+                SearchOptions{ max_result_count, RetrievalMode::MAX_SCORE });
+            ASSERT_EQUAL(pruned.size(), expected.size());
+            for (size_t i = 0; i < expected.size(); ++i) {
+                ASSERT_EQUAL(pruned[i].id, expected[i].id);
+                ASSERT_EQUAL(pruned[i].relevance, expected[i].relevance);
+            }
+        }
+    }
+
+    // Id ranges of parallel retrieval end at the largest id
+    const int max_id = std::numeric_limits<int>::max();
+    server.AddDocument(max_id - 1, "fluffy dog dog tail"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(max_id, "fluffy dog dog"s, DocumentStatus::ACTUAL, { 1 });
+    const auto found = server.FindTopDocuments(std::execution::par, "fluffy dog"s, actual,
+        SearchOptions{ 3, RetrievalMode::MAX_SCORE });
+    ASSERT_EQUAL(found.size(), 3u);
+    ASSERT_EQUAL(found[0].id, max_id);
+    ASSERT_EQUAL(found[1].id, max_id - 1);
+}
+
+void TestCompressedIndexRepresentation() {
+    SearchServer plain_server("and in"s);
+    SearchServer compressed_server("and in"s);
+    compressed_server.SetIndexRepresentation(IndexRepresentation::COMPRESSED);
+    const std::vector<std::string> words = { "cat"s, "dog"s, "city"s, "fluffy"s, "tail"s, "collar"s };
+    for (int document_id = 0; document_id < 1000; ++document_id) {
+        std::string document;
+        for (size_t i = 0; i < words.size(); ++i) {
+            if ((document_id * (i + 3)) % 7 < i + 1) {
+                document += words[i] + " "s;
+            }
+        }
+        document += "word"s + std::to_string(document_id % 50);
+        const DocumentStatus status = document_id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+        plain_server.AddDocument(document_id, document, status, { document_id % 11 });
+        compressed_server.AddDocument(document_id, document, status, { document_id % 11 });
+    }
+    for (int document_id = 0; document_id < 1000; document_id += 3) {
+        plain_server.RemoveDocument(document_id);
+        compressed_server.RemoveDocument(document_id);
+    }
+    plain_server.FinishIndexMerges();
+    compressed_server.FinishIndexMerges();
+    ASSERT(compressed_server.GetIndexMemoryUsage() < plain_server.GetIndexMemoryUsage());
+
+    for (const std::string& query : { "fluffy cat"s, "city dog -tail"s, "word7 collar -cat"s }) {
+        const auto expected = plain_server.FindTopDocuments(query);
+        const auto actual = compressed_server.FindTopDocuments(query);
+        ASSERT_EQUAL(actual.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQUAL(actual[i].id, expected[i].id);
+            ASSERT_EQUAL(actual[i].relevance, expected[i].relevance);
+        }
+        const auto pruned = compressed_server.FindTopDocuments(query,
+            [](int document_id, DocumentStatus status, int rating) {
+                return status == DocumentStatus::ACTUAL;
+            },
+            SearchOptions{ MAX_RESULT_DOCUMENT_COUNT, RetrievalMode::MAX_SCORE });
+        ASSERT_EQUAL(pruned.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQUAL(pruned[i].id, expected[i].id);
+        }
+    }
+
+    // Iterators carry no block buffer of their own, and their copies decode
+    // blocks independently
+    ASSERT(sizeof(PostingList::Iterator) < 128);
+    PostingList postings;
+    for (int document_id = 0; document_id < 1000; document_id += 2) {
+        postings.Add(document_id, document_id / 2, document_id / 1000.0);
+    }
+    postings.SetRepresentation(IndexRepresentation::COMPRESSED);
+    postings.Add(1001, 1001, 1.0);
+    int expected_id = 0;
+    for (PostingList::Iterator it = postings.begin(); it != postings.end();) {
+        const PostingList::Iterator previous = it++;
+        ASSERT_EQUAL((*previous).first, expected_id);
+        // Postings carry the ordinals of their documents through compression
+        ASSERT_EQUAL(previous.Ordinal(), expected_id < 1000 ? expected_id / 2 : expected_id);
+        expected_id += expected_id < 998 ? 2 : 3;
+    }
+    ASSERT_EQUAL(expected_id, 1004);
+
+    compressed_server.SetIndexRepresentation(IndexRepresentation::PLAIN);
+    ASSERT_EQUAL(compressed_server.FindTopDocuments("fluffy tail"s).size(),
+        plain_server.FindTopDocuments("fluffy tail"s).size());
+}
+
+void TestAddDocumentsBatch() {
+    const std::vector<std::string> texts = {
+        "white cat and fashionable collar"s,
+        "fluffy cat fluffy tail"s,
+        "groomed dog expressive eyes"s,
+        "groomed starling eugene"s,
+        "fluffy cat in the city"s,
+        "dog in the city"s,
+    };
+    SearchServer expected_server("and in"s);
+    std::vector<NewDocument> batch;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        const int document_id = static_cast<int>(texts.size() - i) * 2;
+        const DocumentStatus status = i == 3 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+        expected_server.AddDocument(document_id, texts[i], status, { static_cast<int>(i) });
+        batch.push_back({ document_id, texts[i], status, { static_cast<int>(i) } });
+    }
+
+    SearchServer server("and in"s);
+    server.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocuments(std::execution::par, batch);
+    server.RemoveDocument(1);
+    ASSERT_EQUAL(server.GetDocumentCount(), texts.size());
+    for (const std::string& query : { "fluffy groomed cat"s, "city dog -tail"s, "starling"s }) {
+        const auto expected = expected_server.FindTopDocuments(query);
+        const auto actual = server.FindTopDocuments(query);
+        ASSERT_EQUAL(actual.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQUAL(actual[i].id, expected[i].id);
+            ASSERT_EQUAL(actual[i].relevance, expected[i].relevance);
+            ASSERT_EQUAL(actual[i].rating, expected[i].rating);
+        }
+    }
+    ASSERT(server.GetWordFrequencies(4) == expected_server.GetWordFrequencies(4));
+
+    // An invalid document rejects the whole batch
+    const std::vector<NewDocument> duplicate_ids = {
+        { 20, "cat", DocumentStatus::ACTUAL, {} },
+        { 20, "dog", DocumentStatus::ACTUAL, {} },
+    };
+    const std::vector<NewDocument> invalid_word = {
+        { 21, "cat", DocumentStatus::ACTUAL, {} },
+        { 22, "d\x12og", DocumentStatus::ACTUAL, {} },
+    };
+    for (const auto& invalid_batch : { duplicate_ids, invalid_word }) {
+        try {
+            server.AddDocuments(std::execution::par, invalid_batch);
+            ASSERT_HINT(false, "Invalid batch must be rejected"s);
+        }
+        catch (const std::invalid_argument&) {
+        }
+    }
+    ASSERT_EQUAL(server.GetDocumentCount(), texts.size());
+    ASSERT(server.FindTopDocuments("dog"s).size() == 2);
+}
+
+void TestSnapshotRoundTrip() {
+    const std::string path = (std::filesystem::temp_directory_path() / "search_server_test.snapshot").string();
+    {
+        SearchServer server("and in"s);
+        server.AddDocument(0, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, { 8, -3 });
+        server.AddDocument(1, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+        server.AddDocument(2, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+        server.AddDocument(3, "groomed starling eugene"s, DocumentStatus::BANNED, { 9 });
+        server.AddDocument(4, "fluffy cat in the city"s, DocumentStatus::ACTUAL, { 1 });
+        server.RemoveDocument(4);
+        server.SaveSnapshot(path);
+    }
+
+    SearchServer server = SearchServer::LoadSnapshot(path);
+    ASSERT_EQUAL(server.GetDocumentCount(), 4u);
+    const auto found = server.FindTopDocuments("fluffy groomed cat in"s);
+    ASSERT_EQUAL(found.size(), 3u);
+    ASSERT_EQUAL(found[0].id, 1);
+    ASSERT_EQUAL(found[0].rating, 5);
+    ASSERT_EQUAL(found[1].id, 0);
+    ASSERT_EQUAL(found[2].id, 2);
+    ASSERT(server.FindTopDocuments("city"s).empty());
+    ASSERT_EQUAL(server.FindTopDocuments("starling"s, DocumentStatus::BANNED).size(), 1u);
+    ASSERT_EQUAL(server.GetWordFrequencies(1).at("fluffy"s), 0.5);
+
+    // Mapped postings are copied on the first change
+    server.AddDocument(5, "cat in the city"s, DocumentStatus::ACTUAL, { 4 });
+    server.RemoveDocument(0);
+    const auto changed = server.FindTopDocuments("cat"s);
+    ASSERT_EQUAL(changed.size(), 2u);
+    ASSERT_EQUAL(changed[0].id, 5);
+    ASSERT_EQUAL(changed[1].id, 1);
+
+    {
+        std::ofstream corrupted(path, std::ios::binary);
+        corrupted << "not a snapshot"s;
+    }
+    try {
+        SearchServer::LoadSnapshot(path);
+        ASSERT_HINT(false, "Corrupted snapshot must be rejected"s);
+    }
+    catch (const std::runtime_error&) {
+    }
+
+    // Snapshots that do not describe a consistent index are rejected
+    struct SnapshotTerm {
+        std::string term;
+        std::vector<int> document_ids;
+    };
+    struct SnapshotDocument {
+        int id;
+        int32_t status;
+        std::vector<uint64_t> term_indexes;
+    };
+    const auto write_snapshot = [&path](const std::vector<SnapshotTerm>& terms,
+        const std::vector<SnapshotDocument>& documents) {
+        std::ofstream output(path, std::ios::binary);
+        SnapshotWriter writer(output);
+        writer.WriteHeader();
+        writer.Write<uint64_t>(0);
+        writer.Write<uint64_t>(terms.size());
+        for (const SnapshotTerm& term : terms) {
+            const std::vector<double> term_freqs(term.document_ids.size(), 1.0);
+            writer.WriteString(term.term);
+            writer.Write<uint64_t>(term.document_ids.size());
+            writer.Write<double>(1.0);
+            writer.WriteArray(term.document_ids.data(), term.document_ids.size());
+            writer.WriteArray(term_freqs.data(), term_freqs.size());
+        }
+        writer.Write<uint64_t>(documents.size());
+        for (const SnapshotDocument& document : documents) {
+            writer.Write<int32_t>(document.id);
+            writer.Write<int32_t>(0);
+            writer.Write<int32_t>(document.status);
+            writer.Write<uint64_t>(document.term_indexes.size());
+            for (const uint64_t term_index : document.term_indexes) {
+                writer.Write<uint64_t>(term_index);
+                writer.Write<double>(1.0);
+            }
+        }
+    };
+    const auto is_rejected = [&path]() {
+        try {
+            SearchServer::LoadSnapshot(path);
+        }
+        catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+    write_snapshot({ { "cat"s, { 1, 2 } }, { "dog"s, { 2 } } }, { { 1, 0, { 0 } }, { 2, 3, { 0, 1 } } });
+    ASSERT(!is_rejected());
+    write_snapshot({ { "cat"s, { 2, 1 } }, { "dog"s, { 2 } } }, { { 1, 0, { 0 } }, { 2, 0, { 0, 1 } } });
+    ASSERT_HINT(is_rejected(), "Unsorted postings"s);
+    write_snapshot({ { "cat"s, { 1, 1 } } }, { { 1, 0, { 0 } } });
+    ASSERT_HINT(is_rejected(), "Repeated posting"s);
+    write_snapshot({ { "cat"s, { 1, 3 } } }, { { 1, 0, { 0 } } });
+    ASSERT_HINT(is_rejected(), "Posting of an unknown document"s);
+    write_snapshot({ { "cat"s, { 1 } } }, { { 1, 4, { 0 } } });
+    ASSERT_HINT(is_rejected(), "Invalid status"s);
+    write_snapshot({ { "cat"s, { 1 } }, { "cat"s, { 2 } } }, { { 1, 0, { 0 } }, { 2, 0, { 1 } } });
+    ASSERT_HINT(is_rejected(), "Repeated term"s);
+    write_snapshot({ { "cat"s, { 1, 2 } } }, { { 1, 0, { 0, 0 } }, { 2, 0, {} } });
+    ASSERT_HINT(is_rejected(), "Term listed twice by a document"s);
+    write_snapshot({ { "cat"s, { 1 } }, { "dog"s, { 1 } } }, { { 1, 0, { 0 } } });
+    ASSERT_HINT(is_rejected(), "Term missing from its document"s);
+    write_snapshot({ { "cat"s, { 1 } }, { "dog"s, { 1 } } }, { { 1, 0, { 1, 0 } } });
+    ASSERT_HINT(is_rejected(), "Terms of a document out of word order"s);
+    std::filesystem::remove(path);
+}
+
+void TestConcurrentSearchServer() {
+    ConcurrentSearchServer server("and in"s);
+    const int document_count = 200;
+    std::atomic<bool> writing = true;
+    std::thread writer([&server, &writing, document_count] {
+        for (int document_id = 0; document_id < document_count; ++document_id) {
+            server.AddDocument(document_id, "cat number"s + std::to_string(document_id),
+                DocumentStatus::ACTUAL, { document_id });
+        }
+        for (int document_id = 0; document_id < document_count; document_id += 2) {
+            server.RemoveDocument(document_id);
+        }
+        writing = false;
+    });
+
+    // Every query sees a consistent state of the index
+    bool finished = false;
+    while (!finished) {
+        finished = !writing;
+        server.Read([](const SearchServer& snapshot) {
+            const auto found = snapshot.FindTopDocuments("cat"s);
+            ASSERT_EQUAL(found.size(), std::min<size_t>(snapshot.GetDocumentCount(), MAX_RESULT_DOCUMENT_COUNT));
+            for (const Document& document : found) {
+                ASSERT_EQUAL(document.rating, document.id);
+            }
+        });
+    }
+    writer.join();
+
+    ASSERT_EQUAL(server.GetDocumentCount(), static_cast<size_t>(document_count / 2));
+    const auto found = server.FindTopDocuments("cat"s);
+    ASSERT_EQUAL(found.size(), MAX_RESULT_DOCUMENT_COUNT);
+    ASSERT_EQUAL(found[0].id, document_count - 1);
+    ASSERT_EQUAL(std::get<0>(server.MatchDocument("cat number7"s, 7)).size(), 2u);
+}
+
+void TestBackgroundIndexMerging() {
+    SearchServer inline_server("and in"s);
+    inline_server.SetBackgroundIndexMerging(false);
+    SearchServer background_server("and in"s);
+    const auto check_same_results = [&inline_server, &background_server] {
+        for (const std::string& query : { "cat"s, "dog -cat"s, "city tail"s, "word3 cat"s }) {
+            const auto expected = inline_server.FindTopDocuments(query);
+            const auto actual = background_server.FindTopDocuments(query);
+            ASSERT_EQUAL(actual.size(), expected.size());
+            for (size_t i = 0; i < expected.size(); ++i) {
+                ASSERT_EQUAL(actual[i].id, expected[i].id);
+                ASSERT_EQUAL(actual[i].relevance, expected[i].relevance);
+            }
+        }
+        ASSERT_EQUAL(background_server.GetDocumentCount(), inline_server.GetDocumentCount());
+    };
+
+    const std::vector<std::string> texts = { "cat dog"s, "cat city"s, "dog tail"s, "city tail cat"s };
+    for (int round = 0; round < 4; ++round) {
+        for (int document_id = 0; document_id < 2000; ++document_id) {
+            const int id = (document_id * 7919 + round) % 2000 + round * 2000;
+            const std::string text = texts[(id + round) % texts.size()] + " word"s + std::to_string(id % 10);
+            inline_server.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 13 });
+            background_server.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 13 });
+            if (document_id % 3 == 0) {
+                inline_server.RemoveDocument(id - 1);
+                background_server.RemoveDocument(id - 1);
+            }
+        }
+        check_same_results();
+    }
+    background_server.FinishIndexMerges();
+    check_same_results();
+}
+
+void TestQueryExecutor() {
+    SearchServer server("and in"s);
+    for (int document_id = 0; document_id < 300; ++document_id) {
+        server.AddDocument(document_id, "cat dog"s + std::to_string(document_id % 7) + " bird"s + std::to_string(document_id % 11),
+            DocumentStatus::ACTUAL, { document_id % 13 });
+    }
+    std::vector<std::string> queries;
+    for (int i = 0; i < 200; ++i) {
+        queries.push_back("dog"s + std::to_string(i % 7) + " -bird"s + std::to_string(i % 11) + " cat"s);
+    }
+
+    for (const size_t worker_count : { 0, 1, 3 }) {
+        QueryExecutor executor(worker_count);
+        ASSERT_EQUAL(executor.GetWorkerCount(), worker_count);
+        const auto results = ProcessQueries(executor, server, queries);
+        ASSERT_EQUAL(results.size(), queries.size());
+        for (size_t i = 0; i < queries.size(); ++i) {
+            const auto expected = server.FindTopDocuments(queries[i]);
+            ASSERT_EQUAL(results[i].size(), expected.size());
+            for (size_t j = 0; j < expected.size(); ++j) {
+                ASSERT_EQUAL(results[i][j].id, expected[j].id);
+                ASSERT_EQUAL(results[i][j].relevance, expected[j].relevance);
+            }
+        }
+
+        // Parallel searches and nested batches run inline on the workers
+        std::vector<size_t> found_counts(queries.size());
+        executor.ForEach(queries.size(), [&](size_t index) {
+            const auto found = server.FindTopDocuments(std::execution::par, queries[index]);
+            executor.ForEach(1, [&](size_t) {
+                found_counts[index] = found.size();
+            });
+        });
+        for (size_t i = 0; i < queries.size(); ++i) {
+            ASSERT_EQUAL(found_counts[i], results[i].size());
+        }
+
+        try {
+            executor.ForEach(queries.size(), [&](size_t index) {
+                if (index == queries.size() / 2) {
+                    server.FindTopDocuments("cat --dog"s);
+                }
+            });
+            ASSERT_HINT(false, "Exception expected");
+        }
+        catch (const std::invalid_argument&) {
+        }
+
+        std::vector<int> squares(queries.size());
+        QueryExecutor::Submission submission = executor.Submit(squares.size(), [&squares](size_t index) {
+            squares[index] = static_cast<int>(index * index);
+        });
+        submission.Wait();
+        ASSERT_EQUAL(squares.back(), static_cast<int>((squares.size() - 1) * (squares.size() - 1)));
+    }
+}
+
+void TestProcessQueriesJoined() {
+    SearchServer server("and in"s);
+    for (int document_id = 0; document_id < 100; ++document_id) {
+        server.AddDocument(document_id, "cat"s + std::to_string(document_id % 3) + " dog"s + std::to_string(document_id % 10),
+            DocumentStatus::ACTUAL, { document_id });
+    }
+    std::vector<std::string> queries;
+    for (int i = 0; i < 50; ++i) {
+        queries.push_back("dog"s + std::to_string(i % 12) + " cat"s + std::to_string(i % 4));
+    }
+    std::vector<Document> expected;
+    for (const std::string& query : queries) {
+        for (const Document& document : server.FindTopDocuments(query)) {
+            expected.push_back(document);
+        }
+    }
+
+    QueryExecutor executor(2);
+    {
+        const JoinedDocuments joined = ProcessQueriesJoined(executor, server, queries);
+        ASSERT_EQUAL(joined.GetQueryCount(), queries.size());
+        size_t index = 0;
+        for (const Document& document : joined) {
+            ASSERT(index < expected.size());
+            ASSERT_EQUAL(document.id, expected[index].id);
+            ASSERT_EQUAL(document.relevance, expected[index].relevance);
+            ++index;
+        }
+        ASSERT_EQUAL(index, expected.size());
+        ASSERT_EQUAL(joined.GetQueryResults(1).size(), server.FindTopDocuments(queries[1]).size());
+    }
+    {
+        // Stopping early waits for the rest of the batch on destruction
+        const JoinedDocuments joined = ProcessQueriesJoined(executor, server, queries);
+        ASSERT_EQUAL(joined.begin()->id, expected[0].id);
+    }
+    {
+        queries[10] = "cat --dog"s;
+        const JoinedDocuments joined = ProcessQueriesJoined(executor, server, queries);
+        ASSERT_EQUAL(joined.GetQueryResults(9).size(), server.FindTopDocuments(queries[9]).size());
+        try {
+            for (const Document& document : joined) {
+                (void)document;
+            }
+            ASSERT_HINT(false, "Exception expected");
+        }
+        catch (const std::invalid_argument&) {
+        }
+    }
+    {
+        // Every failed query rethrows its own exception
+        const JoinedDocuments joined(executor, 8, 1, [](size_t query) {
+            if (query == 3) {
+                throw std::out_of_range("query 3"s);
+            }
+            if (query == 5) {
+                throw std::invalid_argument("query 5"s);
+            }
+            return std::vector<Document>{ Document(static_cast<int>(query), 0.0, 0) };
+        });
+        for (int repeat = 0; repeat < 2; ++repeat) {
+            try {
+                joined.GetQueryResults(5);
+                ASSERT_HINT(false, "Exception expected");
+            }
+            catch (const std::invalid_argument&) {
+            }
+            try {
+                joined.GetQueryResults(3);
+                ASSERT_HINT(false, "Exception expected");
+            }
+            catch (const std::out_of_range&) {
+            }
+        }
+        ASSERT_EQUAL(joined.GetQueryResults(7)[0].id, 7);
+    }
+}
+
+void TestQueryResultCache() {
+    SearchServer server("and in"s);
+    server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "black dog"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "white dog"s, DocumentStatus::BANNED, { 3 });
+
+    const auto found = server.FindTopDocuments("white dog"s);
+    ASSERT_EQUAL(server.GetResultCacheStats().misses, 1u);
+    // Word order, repeated words and stop words do not change the key
+    const auto cached = server.FindTopDocuments("dog and white dog"s);
+    ASSERT_EQUAL(server.GetResultCacheStats().hits, 1u);
+    ASSERT_EQUAL(cached.size(), found.size());
+    for (size_t i = 0; i < found.size(); ++i) {
+        ASSERT_EQUAL(cached[i].id, found[i].id);
+        ASSERT_EQUAL(cached[i].relevance, found[i].relevance);
+    }
+    ASSERT_EQUAL(server.FindTopDocuments(std::execution::par, "white dog"s).size(), found.size());
+    ASSERT_EQUAL(server.GetResultCacheStats().hits, 2u);
+    ASSERT_EQUAL(server.FindTopDocuments("white dog"s, DocumentStatus::BANNED).size(), 1u);
+    ASSERT_EQUAL(server.FindTopDocuments("white -dog"s).size(), 1u);
+    ASSERT_EQUAL(server.GetResultCacheStats().misses, 3u);
+
+    // Every change of the documents invalidates the cached results
+    const uint64_t generation = server.GetIndexGeneration();
+    server.AddDocument(4, "white bird"s, DocumentStatus::ACTUAL, { 4 });
+    ASSERT(server.GetIndexGeneration() > generation);
+    ASSERT_EQUAL(server.FindTopDocuments("white dog"s).size(), 3u);
+    server.RemoveDocument(4);
+    ASSERT_EQUAL(server.FindTopDocuments("white dog"s).size(), 2u);
+    ASSERT_EQUAL(server.GetResultCacheStats().hits, 2u);
+
+    RequestQueue request_queue(server);
+    request_queue.AddFindRequest("black cat"s);
+    request_queue.AddFindRequest("cat black"s);
+    request_queue.AddFindRequest("cat black"s, [](int document_id, DocumentStatus status, int rating) {
+        return true;
+    });
+    ASSERT_EQUAL(request_queue.GetCachedResultRequests(), 1);
+    ASSERT_EQUAL(request_queue.GetResultCacheStats().hits, 3u);
+
+    server.SetResultCacheCapacity(0);
+    server.FindTopDocuments("black cat"s);
+    server.FindTopDocuments("black cat"s);
+    ASSERT_EQUAL(server.GetResultCacheStats().hits, 0u);
+
+    // Each shard keeps its most recently used entries
+    QueryResultCache cache(16);
+    for (int i = 0; i < 100; ++i) {
+        cache.Insert(std::to_string(i), 1, { Document(i, 0.0, 0) });
+    }
+    int cached_count = 0;
+    for (int i = 0; i < 100; ++i) {
+        cached_count += cache.Find(std::to_string(i), 1).has_value();
+    }
+    ASSERT(cached_count > 0 && cached_count <= 16);
+    ASSERT_EQUAL(cache.Find("99"s, 1)->at(0).id, 99);
+    ASSERT(!cache.Find("99"s, 2));
+    ASSERT(!cache.Find("99"s, 2));
+}
+
+void TestForEachWord() {
+    // Covers words crossing the blocks scanned at once and the scalar tail
+    const std::string alphabet = "ab -\t\x7f\x80"s;
+    for (size_t length = 0; length < 70; ++length) {
+        for (size_t seed = 0; seed < 20; ++seed) {
+            std::string text;
+            for (size_t i = 0; i < length; ++i) {
+                text += alphabet[(i * 7 + seed * 13 + i * i * seed) % alphabet.size()];
+            }
+
+            std::vector<std::string_view> expected_words;
+            std::vector<bool> expected_control_chars;
+            size_t word_begin = 0;
+            for (size_t i = 0; i <= text.size(); ++i) {
+                if (i == text.size() || text[i] == ' ') {
+                    const std::string_view word = std::string_view(text).substr(word_begin, i - word_begin);
+                    expected_words.push_back(word);
+                    expected_control_chars.push_back(word.find('\t') != std::string_view::npos);
+                    word_begin = i + 1;
+                }
+            }
+
+            size_t index = 0;
+            ForEachWord(text, [&](std::string_view word, bool has_control_chars) {
+                ASSERT(index < expected_words.size());
+                ASSERT_EQUAL(word, expected_words[index]);
+                ASSERT_EQUAL(has_control_chars, expected_control_chars[index]);
+                ++index;
+            });
+            ASSERT_EQUAL(index, expected_words.size());
+        }
+    }
+
+    SearchServer server("in"s);
+    server.AddDocument(1, "cat  in the  city of cat"s, DocumentStatus::ACTUAL, { 1 });
+    const auto word_frequencies = server.GetWordFrequencies(1);
+    ASSERT_EQUAL(word_frequencies.at("cat"), 2.0 / 7);
+    ASSERT_EQUAL(word_frequencies.at(""), 2.0 / 7);
+    try {
+        server.AddDocument(2, "a long document with a control\x12 character"s, DocumentStatus::ACTUAL, { 1 });
+        ASSERT_HINT(false, "Exception expected");
+    }
+    catch (const std::invalid_argument&) {
+    }
+    try {
+        server.FindTopDocuments("a long query with a control\x12 character"s);
+        ASSERT_HINT(false, "Exception expected");
+    }
+    catch (const std::invalid_argument&) {
+    }
+}
+
+void TestStopWordSet() {
+    ASSERT(!StopWordSet().Contains("in"s));
+
+    std::set<std::string, std::less<>> words;
+    for (int i = 0; i < 300; ++i) {
+        words.insert("w"s + std::to_string(i * 7));
+    }
+    words.insert(std::string(100, 'x'));
+    const StopWordSet stop_words(words);
+    ASSERT_EQUAL(stop_words.size(), words.size());
+    for (const std::string& word : words) {
+        ASSERT(stop_words.Contains(word));
+    }
+    for (int i = 0; i < 300; ++i) {
+        ASSERT_EQUAL(stop_words.Contains("w"s + std::to_string(i)), i % 7 == 0);
+    }
+    ASSERT(!stop_words.Contains(""s));
+    ASSERT(!stop_words.Contains("w"s));
+    ASSERT(!stop_words.Contains(std::string(99, 'x')));
+    ASSERT(!stop_words.Contains(std::string(101, 'x')));
+
+    // A moved server keeps a working set
+    SearchServer original("a in the"s);
+    SearchServer server(std::move(original));
+    server.AddDocument(1, "the cat in a city"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(server.GetWordFrequencies(1).size(), 2u);
+    ASSERT(server.FindTopDocuments("the a in"s).empty());
+}
+
+void TestDocumentOrdinalMap() {
+    DocumentOrdinalMap ordinals;
+    ASSERT_EQUAL(ordinals.Find(1), -1);
+    std::map<int, int> expected;
+    uint32_t state = 12345;
+    for (int step = 0; step < 20000; ++step) {
+        state = state * 1103515245 + 12345;
+        // Clustered ids make long probe runs for the removals to repair
+        const int document_id = static_cast<int>((state >> 8) % 600) * 1024;
+        if (expected.count(document_id) > 0) {
+            ordinals.Erase(document_id);
+            expected.erase(document_id);
+        }
+        else {
+            ordinals.Insert(document_id, step);
+            expected[document_id] = step;
+        }
+        if (step % 1000 == 0) {
+            for (int id = 0; id < 600 * 1024; id += 1024) {
+                const auto it = expected.find(id);
+                ASSERT_EQUAL(ordinals.Find(id), it == expected.end() ? -1 : it->second);
+            }
+        }
+    }
+    ASSERT_EQUAL(ordinals.size(), expected.size());
+
+    // Status searches and predicates see the attributes of reused ordinals
+    SearchServer server("and"s);
+    server.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "cat dog"s, DocumentStatus::BANNED, { 2 });
+    server.RemoveDocument(1);
+    server.AddDocument(3, "cat"s, DocumentStatus::IRRELEVANT, { 3 });
+    ASSERT(server.FindTopDocuments("cat"s).empty());
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s, DocumentStatus::IRRELEVANT).at(0).rating, 3);
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s, DocumentStatusPredicate{ DocumentStatus::BANNED }).at(0).id, 2);
+    const auto found = server.FindTopDocuments("cat"s, [](int document_id, DocumentStatus status, int rating) {
+        return rating > 1;
+    });
+    ASSERT_EQUAL(found.size(), 2u);
+}
+
+void TestDocumentFilter() {
+    SearchServer server("and"s);
+    for (int document_id = 0; document_id < 300; ++document_id) {
+        server.AddDocument(document_id * 3, "cat dog"s + std::to_string(document_id % 5),
+            static_cast<DocumentStatus>(document_id % 4), { document_id % 50 - 25 });
+    }
+    for (int document_id = 0; document_id < 300; document_id += 7) {
+        server.RemoveDocument(document_id * 3);
+    }
+
+    DocumentFilter filter;
+    filter.status_mask = DocumentFilter::GetStatusBit(DocumentStatus::ACTUAL)
+        | DocumentFilter::GetStatusBit(DocumentStatus::BANNED);
+    filter.min_rating = -10;
+    filter.max_rating = 12;
+    const auto predicate = [](int document_id, DocumentStatus status, int rating) {
+        return (status == DocumentStatus::ACTUAL || status == DocumentStatus::BANNED) && rating >= -10 && rating <= 12;
+    };
+    for (const size_t max_result_count : { 5, 100 }) {
+        const SearchOptions options{ max_result_count };
+        const auto expected = server.FindTopDocuments("cat dog1"s, predicate, options);
+        ASSERT(!expected.empty());
+        const auto found = server.FindTopDocuments("cat dog1"s, filter, options);
+        const auto found_parallel = server.FindTopDocuments(std::execution::par, "cat dog1"s, filter, options);
+        ASSERT_EQUAL(found.size(), expected.size());
+        ASSERT_EQUAL(found_parallel.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQUAL(found[i].id, expected[i].id);
+            ASSERT_EQUAL(found[i].relevance, expected[i].relevance);
+            ASSERT_EQUAL(found_parallel[i].id, expected[i].id);
+        }
+    }
+
+    // The default filter accepts everything
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s, DocumentFilter{}, SearchOptions{ 1000 }).size(),
+        server.GetDocumentCount());
+
+    // Queries with few postings test the filter per posting
+    for (int document_id = 1000; document_id < 1008; ++document_id) {
+        server.AddDocument(document_id, "rare parrot"s, static_cast<DocumentStatus>(document_id % 4),
+            { (document_id % 3) * 10 - 10 });
+    }
+    const auto expected_rare = server.FindTopDocuments("parrot"s, predicate, SearchOptions{});
+    ASSERT_EQUAL(expected_rare.size(), 4u);
+    for (const auto& found : { server.FindTopDocuments("parrot"s, filter),
+        server.FindTopDocuments(std::execution::par, "parrot"s, filter) }) {
+        ASSERT_EQUAL(found.size(), expected_rare.size());
+        for (size_t i = 0; i < expected_rare.size(); ++i) {
+            ASSERT_EQUAL(found[i].id, expected_rare[i].id);
+            ASSERT_EQUAL(found[i].relevance, expected_rare[i].relevance);
+        }
+    }
+}
+
+void TestShardedSearchServer() {
+    SearchServer server("and in"s);
+    ShardedSearchServer sharded_server("and in"s, 3);
+    ASSERT_EQUAL(sharded_server.GetShardCount(), 3u);
+    for (int document_id = 0; document_id < 200; ++document_id) {
+        const std::string text = "cat"s + std::to_string(document_id % 4) + " and dog"s + std::to_string(document_id % 9)
+            + " bird"s + std::to_string(document_id % 13 / 3);
+        const auto status = static_cast<DocumentStatus>(document_id % 5 == 0 ? 2 : 0);
+        server.AddDocument(document_id, text, status, { document_id % 17 });
+        sharded_server.AddDocument(document_id, text, status, { document_id % 17 });
+    }
+    for (int document_id = 0; document_id < 200; document_id += 11) {
+        server.RemoveDocument(document_id);
+        sharded_server.RemoveDocument(document_id);
+    }
+    ASSERT_EQUAL(sharded_server.GetDocumentCount(), server.GetDocumentCount());
+
+    const auto check_same = [](const std::vector<Document>& found, const std::vector<Document>& expected) {
+        ASSERT_EQUAL(found.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQUAL(found[i].id, expected[i].id);
+            ASSERT_EQUAL(found[i].relevance, expected[i].relevance);
+            ASSERT_EQUAL(found[i].rating, expected[i].rating);
+        }
+    };
+    for (const std::string& query : { "cat1 dog2"s, "bird0 -cat3"s, "dog7 bird2 cat0 unknown"s, "unknown"s }) {
+        check_same(sharded_server.FindTopDocuments(query), server.FindTopDocuments(query));
+        check_same(sharded_server.FindTopDocuments(query, DocumentStatus::BANNED),
+            server.FindTopDocuments(query, DocumentStatus::BANNED));
+        const auto odd = [](int document_id, DocumentStatus status, int rating) {
+            return document_id % 2 == 1;
+        };
+        const SearchOptions options{ 50, RetrievalMode::MAX_SCORE };
+        check_same(sharded_server.FindTopDocuments(query, odd, options), server.FindTopDocuments(query, odd, options));
+    }
+
+    ASSERT_EQUAL(std::get<0>(sharded_server.MatchDocument("cat1 dog9"s, 1)).size(), 1u);
+    try {
+        sharded_server.FindTopDocuments("cat --dog"s);
+        ASSERT_HINT(false, "Exception expected");
+    }
+    catch (const std::invalid_argument&) {
+    }
+}
+
+void TestRemoveDocuments() {
+    SearchServer one_by_one_server("and in"s);
+    SearchServer batch_server("and in"s);
+    batch_server.SetIndexRepresentation(IndexRepresentation::COMPRESSED);
+    for (int document_id = 0; document_id < 1000; ++document_id) {
+        const std::string text = "cat"s + std::to_string(document_id % 7) + " dog"s + std::to_string(document_id % 31)
+            + " unique"s + std::to_string(document_id);
+        one_by_one_server.AddDocument(document_id, text, DocumentStatus::ACTUAL, { document_id % 10 });
+        batch_server.AddDocument(document_id, text, DocumentStatus::ACTUAL, { document_id % 10 });
+    }
+    batch_server.FinishIndexMerges();
+    const size_t memory_usage = batch_server.GetIndexMemoryUsage();
+
+    std::vector<int> removed_ids;
+    for (int document_id = 0; document_id < 1000; document_id += 3) {
+        removed_ids.push_back(document_id);
+        one_by_one_server.RemoveDocument(document_id);
+    }
+    // Duplicates and unknown ids are skipped
+    removed_ids.push_back(3);
+    removed_ids.push_back(5000);
+    batch_server.RemoveDocuments(std::execution::par, removed_ids);
+    ASSERT_EQUAL(batch_server.GetDocumentCount(), one_by_one_server.GetDocumentCount());
+
+    for (const std::string& query : { "cat1"s, "dog4 -cat2"s, "cat3 dog30 unique4"s, "unique3"s }) {
+        const auto expected = one_by_one_server.FindTopDocuments(query, DocumentStatus::ACTUAL);
+        const auto found = batch_server.FindTopDocuments(query, DocumentStatus::ACTUAL);
+        ASSERT_EQUAL(found.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQUAL(found[i].id, expected[i].id);
+            ASSERT_EQUAL(found[i].relevance, expected[i].relevance);
+        }
+    }
+    ASSERT(batch_server.FindTopDocuments("unique3"s).empty());
+
+    // Terms of removed documents are dropped with their postings
+    batch_server.FinishIndexMerges();
+    ASSERT(batch_server.GetIndexMemoryUsage() < memory_usage);
+    batch_server.RemoveDocuments({ 1, 2, 4 });
+    ASSERT_EQUAL(batch_server.GetDocumentCount(), one_by_one_server.GetDocumentCount() - 3);
+}
+
+void TestFindDuplicates() {
+    SearchServer search_server("and with"s);
+    search_server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    search_server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+    // Word order, repeated words and stop words do not matter
+    search_server.AddDocument(3, "nasty rat funny pet funny"s, DocumentStatus::ACTUAL, { 1, 2 });
+    search_server.AddDocument(4, "funny pet with curly hair"s, DocumentStatus::BANNED, { 1, 2 });
+    search_server.AddDocument(5, "nasty rat with curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+    search_server.AddDocument(6, "funny pet and curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+
+    const std::vector<int> expected{ 3, 4, 6 };
+    ASSERT(FindDuplicates(search_server) == expected);
+    ASSERT(FindDuplicates(std::execution::par, search_server) == expected);
+
+    SearchServer near_server(""s);
+    std::string common_text;
+    for (int word = 0; word < 40; ++word) {
+        common_text += " word"s + std::to_string(word);
+    }
+    near_server.AddDocument(1, common_text, DocumentStatus::ACTUAL, { 1 });
+    // 40 of 42 words are shared with document 1
+    near_server.AddDocument(2, common_text + " extra1 extra2"s, DocumentStatus::ACTUAL, { 1 });
+    // 20 of 60 words are shared with document 1
+    std::string other_text;
+    for (int word = 20; word < 60; ++word) {
+        other_text += " word"s + std::to_string(word);
+    }
+    near_server.AddDocument(3, other_text, DocumentStatus::ACTUAL, { 1 });
+    near_server.AddDocument(4, "something else entirely"s, DocumentStatus::ACTUAL, { 1 });
+
+    DuplicateSearchOptions options;
+    options.jaccard_threshold = 0.8;
+    ASSERT(FindDuplicates(near_server, options) == std::vector<int>{ 2 });
+    ASSERT(FindDuplicates(std::execution::par, near_server, options) == std::vector<int>{ 2 });
+    ASSERT(FindDuplicates(near_server).empty());
+
+    RemoveDuplicates(search_server);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 3);
+    ASSERT_EQUAL(search_server.FindTopDocuments("funny"s).size(), 2u);
+}
+
+void TestDuplicateDetection() {
+    SearchServer search_server("and with"s);
+    search_server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    search_server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, { 1, 2 });
+    search_server.AddDocument(3, "nasty rat funny pet funny"s, DocumentStatus::ACTUAL, { 1, 2 });
+    ASSERT(!search_server.FindOriginalDocument(3));
+
+    // Documents added before the detection is enabled are indexed too
+    search_server.SetDuplicateDetection(DuplicateDetection::REPORT);
+    ASSERT(!search_server.FindOriginalDocument(1));
+    ASSERT_EQUAL(*search_server.FindOriginalDocument(3), 1);
+    search_server.AddDocument(5, "curly hair funny pet"s, DocumentStatus::BANNED, { 1, 2 });
+    ASSERT_EQUAL(*search_server.FindOriginalDocument(5), 2);
+    search_server.AddDocuments({ { 4, "rat nasty pet funny"s, DocumentStatus::ACTUAL, { 1 } },
+        { 6, "funny pet"s, DocumentStatus::ACTUAL, { 1 } },
+        { 7, "pet funny"s, DocumentStatus::ACTUAL, { 1 } } });
+    ASSERT_EQUAL(*search_server.FindOriginalDocument(4), 1);
+    ASSERT_EQUAL(*search_server.FindOriginalDocument(7), 6);
+    ASSERT(FindDuplicates(search_server) == std::vector<int>({ 3, 4, 5, 7 }));
+    ASSERT(FindDuplicates(std::execution::par, search_server) == std::vector<int>({ 3, 4, 5, 7 }));
+    ASSERT(search_server.FindDuplicateDocuments() == std::vector<int>({ 3, 4, 5, 7 }));
+
+    // The next document with the same words becomes the original
+    search_server.RemoveDocument(1);
+    ASSERT(!search_server.FindOriginalDocument(3));
+    ASSERT_EQUAL(*search_server.FindOriginalDocument(4), 3);
+    search_server.RemoveDocuments({ 3, 6 });
+    ASSERT(!search_server.FindOriginalDocument(4));
+    ASSERT(!search_server.FindOriginalDocument(7));
+    search_server.RemoveDocument(std::execution::par, 2);
+    ASSERT(!search_server.FindOriginalDocument(5));
+    ASSERT(search_server.FindDuplicateDocuments().empty());
+
+    search_server.SetDuplicateDetection(DuplicateDetection::REJECT);
+    try {
+        search_server.AddDocument(8, "hair curly pet funny"s, DocumentStatus::ACTUAL, { 1 });
+        ASSERT_HINT(false, "Duplicate document must be rejected"s);
+    }
+    catch (const std::invalid_argument&) {
+    }
+    // A batch is rejected as a whole, also for duplicates within it
+    try {
+        search_server.AddDocuments({ { 8, "dog"s, DocumentStatus::ACTUAL, { 1 } },
+            { 9, "dog and dog"s, DocumentStatus::ACTUAL, { 1 } } });
+        ASSERT_HINT(false, "Duplicate document must be rejected"s);
+    }
+    catch (const std::invalid_argument&) {
+    }
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 3u);
+    ASSERT(search_server.FindTopDocuments("dog"s).empty());
+    search_server.AddDocument(8, "funny pet and curly rat"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 4u);
+
+    search_server.SetDuplicateDetection(DuplicateDetection::DISABLED);
+    search_server.AddDocument(9, "funny pet curly rat"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT(!search_server.FindOriginalDocument(9));
+}
+
+void TestRequestStatistics() {
+    using namespace std::chrono;
+    const RequestStatistics::Clock::time_point start{};
+    RequestStatistics statistics(3, start);
+    statistics.Record(0, false, microseconds(1), start);
+    statistics.Record(2, true, microseconds(5), start + seconds(30));
+    statistics.Record(0, false, microseconds(100), start + minutes(1));
+    RequestWindowStats recent = statistics.GetRecentRequests();
+    ASSERT_EQUAL(recent.request_count, 3u);
+    ASSERT_EQUAL(recent.empty_result_count, 2u);
+    ASSERT_EQUAL(recent.cached_result_count, 1u);
+    ASSERT_EQUAL(recent.document_count, 2u);
+
+    // The oldest request leaves the window
+    statistics.Record(4, false, milliseconds(1), start + minutes(1000));
+    recent = statistics.GetRecentRequests();
+    ASSERT_EQUAL(recent.request_count, 3u);
+    ASSERT_EQUAL(recent.empty_result_count, 1u);
+    ASSERT_EQUAL(recent.document_count, 6u);
+
+    RequestWindowStats day = statistics.GetLastDay(start + minutes(1000));
+    ASSERT_EQUAL(day.request_count, 4u);
+    ASSERT_EQUAL(day.empty_result_count, 2u);
+    ASSERT_EQUAL(day.document_count, 6u);
+    day = statistics.GetLastDay(start + minutes(1440));
+    ASSERT_EQUAL(day.request_count, 2u);
+    ASSERT_EQUAL(day.empty_result_count, 1u);
+    ASSERT_EQUAL(day.cached_result_count, 0u);
+    // A minute bucket of the previous day is reset by its next request
+    statistics.Record(1, false, microseconds(1), start + minutes(1441));
+    day = statistics.GetLastDay(start + minutes(1441));
+    ASSERT_EQUAL(day.request_count, 2u);
+    ASSERT_EQUAL(day.document_count, 5u);
+
+    const auto histogram = statistics.GetLatencyHistogram();
+    ASSERT_EQUAL(histogram[1], 2u);
+    ASSERT_EQUAL(histogram[3], 1u);
+    ASSERT_EQUAL(histogram[7], 1u);
+    ASSERT_EQUAL(histogram[10], 1u);
+
+    SearchServer server("and in"s);
+    server.AddDocument(1, "curly cat"s, DocumentStatus::ACTUAL, { 1 });
+    RequestQueue request_queue(server);
+    for (int i = 0; i < 1439; ++i) {
+        request_queue.AddFindRequest("empty request"s);
+    }
+    request_queue.AddFindRequest("curly dog"s);
+    request_queue.AddFindRequest("big collar"s);
+    request_queue.AddFindRequest("cat"s, DocumentStatus::ACTUAL);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1438);
+    ASSERT_EQUAL(request_queue.GetStatistics().GetRecentRequests().document_count, 2u);
+    ASSERT_EQUAL(request_queue.GetStatistics().GetLastDay().request_count, 1442u);
+
+    // Requests may be added concurrently
+    std::vector<std::thread> threads;
+    for (int thread_index = 0; thread_index < 4; ++thread_index) {
+        threads.emplace_back([&request_queue] {
+            for (int i = 0; i < 500; ++i) {
+                request_queue.AddFindRequest("curly"s);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 0);
+    ASSERT_EQUAL(request_queue.GetStatistics().GetRecentRequests().document_count, 1440u);
+    ASSERT_EQUAL(request_queue.GetStatistics().GetLastDay().request_count, 3442u);
+
+    // Every request reports its own cache hit, whatever other threads search
+    RequestQueue predicate_queue(server);
+    std::thread cached_searches([&request_queue] {
+        for (int i = 0; i < 500; ++i) {
+            request_queue.AddFindRequest("curly"s);
+        }
+    });
+    for (int i = 0; i < 500; ++i) {
+        predicate_queue.AddFindRequest("curly"s, [](int, DocumentStatus, int) {
+            return true;
+        });
+    }
+    cached_searches.join();
+    ASSERT_EQUAL(predicate_queue.GetCachedResultRequests(), 0);
+    ASSERT_EQUAL(request_queue.GetCachedResultRequests(), 1440);
+}
+
+void TestQueryMetrics() {
+    SearchServer server("and in"s);
+    server.AddDocument(1, "white cat and fancy collar"s, DocumentStatus::ACTUAL, { 8, -3 });
+    server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+
+    // Nothing is recorded while the metrics are disabled
+    const MetricsSnapshot before = GetMetricsSnapshot();
+    server.FindTopDocuments("fluffy cat"s, DocumentStatus::BANNED);
+    const MetricsSnapshot disabled = GetMetricsSnapshot();
+    ASSERT_EQUAL(disabled[QueryPhase::PARSE].count, before[QueryPhase::PARSE].count);
+    ASSERT_EQUAL(disabled[QueryCounter::POSTINGS_SCANNED], before[QueryCounter::POSTINGS_SCANNED]);
+
+    SetMetricsEnabled(true);
+    ASSERT(AreMetricsEnabled() == METRICS_COMPILED);
+    server.FindTopDocuments("fluffy cat -dog"s);
+    server.FindTopDocuments("fluffy cat -dog"s);
+    server.FindTopDocuments("cat eyes"s, DocumentFilter{ DocumentFilter::ALL_STATUSES, 0, 10 });
+    server.FindTopDocuments("cat dog"s, [](int document_id, DocumentStatus status, int rating) {
+        return true;
+    }, SearchOptions{ 1, RetrievalMode::MAX_SCORE });
+    ProcessQueries(server, { "white cat"s, "dog"s });
+    RequestQueue request_queue(server);
+    request_queue.AddFindRequest("fluffy"s);
+    SetMetricsEnabled(false);
+    const MetricsSnapshot after = GetMetricsSnapshot();
+
+    if constexpr (METRICS_COMPILED) {
+        ASSERT_EQUAL(after[QueryPhase::PARSE].count - disabled[QueryPhase::PARSE].count, 7u);
+        ASSERT_EQUAL(after[QueryPhase::QUERY].count - disabled[QueryPhase::QUERY].count, 3u);
+        ASSERT(after[QueryPhase::FILTERING].count > disabled[QueryPhase::FILTERING].count);
+        ASSERT(after[QueryPhase::POSTING_TRAVERSAL].count > disabled[QueryPhase::POSTING_TRAVERSAL].count);
+        ASSERT(after[QueryPhase::TOP_K].count > disabled[QueryPhase::TOP_K].count);
+        ASSERT(after[QueryPhase::RESULT_BUILD].count > disabled[QueryPhase::RESULT_BUILD].count);
+        ASSERT_EQUAL(after[QueryCounter::RESULT_CACHE_HITS] - disabled[QueryCounter::RESULT_CACHE_HITS], 1u);
+        ASSERT(after[QueryCounter::POSTINGS_SCANNED] > disabled[QueryCounter::POSTINGS_SCANNED]);
+        ASSERT(after[QueryCounter::DOCUMENTS_SCORED] > disabled[QueryCounter::DOCUMENTS_SCORED]);
+        uint64_t histogram_count = 0;
+        for (const uint64_t count : after[QueryPhase::PARSE].histogram) {
+            histogram_count += count;
+        }
+        ASSERT_EQUAL(histogram_count, after[QueryPhase::PARSE].count);
+    }
+
+    std::ostringstream out;
+    out << after;
+    ASSERT(out.str().find("posting_traversal: count = "s) != std::string::npos);
+    ASSERT(out.str().find("result_cache_hits: "s) != std::string::npos);
+}
+
 void TestSearchServer() {
     RUN_TEST(TestExcludeStopWordsFromAddedDocumentContent);
     RUN_TEST(TestAddingDocument);
@@ -211,4 +1362,26 @@ void TestSearchServer() {
     RUN_TEST(TestFilterPredicateDocument);
     RUN_TEST(TestFilterStatusDocument);
     RUN_TEST(TestCorectCalculationRelevanceDocuments);
+    RUN_TEST(TestInverseDocumentFreqCacheInvalidation);
+    RUN_TEST(TestRemoveAndReAddDocument);
+    RUN_TEST(TestMaxResultCount);
+    RUN_TEST(TestMaxScoreRetrieval);
+    RUN_TEST(TestCompressedIndexRepresentation);
+    RUN_TEST(TestAddDocumentsBatch);
+    RUN_TEST(TestSnapshotRoundTrip);
+    RUN_TEST(TestConcurrentSearchServer);
+    RUN_TEST(TestBackgroundIndexMerging);
+    RUN_TEST(TestQueryExecutor);
+    RUN_TEST(TestProcessQueriesJoined);
+    RUN_TEST(TestQueryResultCache);
+    RUN_TEST(TestForEachWord);
+    RUN_TEST(TestStopWordSet);
+    RUN_TEST(TestDocumentOrdinalMap);
+    RUN_TEST(TestDocumentFilter);
+    RUN_TEST(TestShardedSearchServer);
+    RUN_TEST(TestRemoveDocuments);
+    RUN_TEST(TestFindDuplicates);
+    RUN_TEST(TestDuplicateDetection);
+    RUN_TEST(TestRequestStatistics);
+    RUN_TEST(TestQueryMetrics);
 }
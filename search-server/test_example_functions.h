@@ -1,9 +1,22 @@
 #pragma once
 
 #include "document.h"
+#include "index_snapshot.h"
 #include "search_server.h"
+#include "concurrent_search_server.h"
+#include "process_queries.h"
+#include "query_executor.h"
+#include "query_metrics.h"
+#include "remove_duplicates.h"
+#include "request_queue.h"
+#include "sharded_search_server.h"
  
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 // -------- Начало модульных тестов поисковой системы ----------
@@ -26,6 +39,50 @@ void TestFilterStatusDocument();
 
 void TestCorectCalculationRelevanceDocuments();
 
+void TestInverseDocumentFreqCacheInvalidation();
+
+void TestRemoveAndReAddDocument();
+
+void TestMaxResultCount();
+
+void TestMaxScoreRetrieval();
+
+void TestCompressedIndexRepresentation();
+
+void TestAddDocumentsBatch();
+
+void TestSnapshotRoundTrip();
+
+void TestConcurrentSearchServer();
+
+void TestBackgroundIndexMerging();
+
+void TestQueryExecutor();
+
+void TestProcessQueriesJoined();
+
+void TestQueryResultCache();
+
+void TestForEachWord();
+
+void TestStopWordSet();
+
+void TestDocumentOrdinalMap();
+
+void TestDocumentFilter();
+
+void TestShardedSearchServer();
+
+void TestRemoveDocuments();
+
+void TestFindDuplicates();
+
+void TestDuplicateDetection();
+
+void TestRequestStatistics();
+
+void TestQueryMetrics();
+
 // Функция TestSearchServer является точкой входа для запуска тестов
 void TestSearchServer();
 
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <optional>
+
+// Lease of a per-thread object whose buffers are reused by the next lease
+// on the same thread. A lease taken while the thread's object is already
+// leased, as by a search started from a document predicate, gets an
+// object of its own, so nested users never overwrite each other.
+template <typename T>
+class ScratchLease {
+public:
+    ScratchLease() {
+        thread_local Slot slot;
+        if (!slot.is_leased) {
+            slot.is_leased = true;
+            slot_ = &slot;
+            object_ = &slot.object;
+        }
+        else {
+            object_ = &fallback_.emplace();
+        }
+    }
+
+    ScratchLease(const ScratchLease&) = delete;
+    ScratchLease& operator=(const ScratchLease&) = delete;
+
+    ~ScratchLease() {
+        if (slot_ != nullptr) {
+            slot_->is_leased = false;
+        }
+    }
+
+    T& operator*() const {
+        return *object_;
+    }
+
+    T* operator->() const {
+        return object_;
+    }
+
+private:
+    struct Slot {
+        T object;
+        bool is_leased = false;
+    };
+
+    Slot* slot_ = nullptr;
+    T* object_ = nullptr;
+    std::optional<T> fallback_;
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "document.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+const size_t MAX_RESULT_DOCUMENT_COUNT = 5;
+const double MIN_DIFFERENCE_RELEVANCE = 1e-6;
+
+enum class RetrievalMode {
+    // Scores every posting of every query word
+    EXHAUSTIVE,
+    // Walks documents in id order and skips those whose score upper bound
+    // cannot reach the current top; returns the same documents as EXHAUSTIVE
+    MAX_SCORE,
+};
+
+struct SearchOptions {
+    size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT;
+    RetrievalMode retrieval_mode = RetrievalMode::EXHAUSTIVE;
+};
+
+// Result order: by relevance, then by rating when relevances differ by less
+// than MIN_DIFFERENCE_RELEVANCE, then by id
+inline bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < MIN_DIFFERENCE_RELEVANCE) {
+        if (lhs.rating != rhs.rating) {
+            return lhs.rating > rhs.rating;
+        }
+        return lhs.id < rhs.id;
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
+// Keeps the best max_count documents added so far in a heap whose front is
+// the least relevant of them, so a candidate costs O(log max_count).
+class TopDocuments {
+public:
+    explicit TopDocuments(size_t max_count)
+        : max_count_(max_count) {
+        heap_.reserve(max_count);
+    }
+
+    void Add(const Document& document) {
+        if (heap_.size() < max_count_) {
+            heap_.push_back(document);
+            std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        }
+        else if (max_count_ > 0 && IsMoreRelevant(document, heap_.front())) {
+            std::pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+            heap_.back() = document;
+            std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        }
+    }
+
+    void Merge(const TopDocuments& other) {
+        for (const Document& document : other.heap_) {
+            Add(document);
+        }
+    }
+
+    // Returns the kept documents, most relevant first, and leaves the object empty
+    std::vector<Document> Extract() {
+        std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        std::vector<Document> result = std::move(heap_);
+        heap_.clear();
+        return result;
+    }
+
+    size_t size() const {
+        return heap_.size();
+    }
+
+    bool IsFull() const {
+        return heap_.size() == max_count_;
+    }
+
+    // The least relevant kept document; the object must not be empty
+    const Document& Worst() const {
+        return heap_.front();
+    }
+
+private:
+    size_t max_count_;
+    std::vector<Document> heap_;
+};
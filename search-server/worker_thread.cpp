@@ -0,0 +1,51 @@
+#include "worker_thread.h"
+
+WorkerThread::WorkerThread()
+    : thread_([this] { Run(); }) {
+}
+
+WorkerThread::~WorkerThread() {
+    {
+        const std::lock_guard guard(mutex_);
+        stopping_ = true;
+    }
+    task_added_.notify_one();
+    thread_.join();
+}
+
+void WorkerThread::Submit(std::function<void()> task) {
+    {
+        const std::lock_guard guard(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+    task_added_.notify_one();
+}
+
+void WorkerThread::WaitIdle() {
+    std::unique_lock lock(mutex_);
+    idle_.wait(lock, [this] {
+        return tasks_.empty() && !running_task_;
+    });
+}
+
+void WorkerThread::Run() {
+    std::unique_lock lock(mutex_);
+    while (true) {
+        task_added_.wait(lock, [this] {
+            return !tasks_.empty() || stopping_;
+        });
+        if (tasks_.empty()) {
+            return;
+        }
+        std::function<void()> task = std::move(tasks_.front());
+        tasks_.pop_front();
+        running_task_ = true;
+        lock.unlock();
+        task();
+        lock.lock();
+        running_task_ = false;
+        if (tasks_.empty()) {
+            idle_.notify_all();
+        }
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Runs tasks one after another on a dedicated thread.
+// The destructor finishes the submitted tasks before joining the thread.
+class WorkerThread {
+public:
+    WorkerThread();
+
+    WorkerThread(const WorkerThread&) = delete;
+    WorkerThread& operator=(const WorkerThread&) = delete;
+
+    ~WorkerThread();
+
+    void Submit(std::function<void()> task);
+
+    // Returns when all tasks submitted before the call are done
+    void WaitIdle();
+
+private:
+    void Run();
+
+    std::mutex mutex_;
+    std::condition_variable task_added_;
+    std::condition_variable idle_;
+    std::deque<std::function<void()>> tasks_;
+    bool running_task_ = false;
+    bool stopping_ = false;
+    std::thread thread_;
+};